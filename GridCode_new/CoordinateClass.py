@@ -1,20 +1,40 @@
+from unit_conversion import AXES
+
+
 class Coordinates:
 
     """
     Args:
         x (float): X coordinate in millimeters from grid selector
         y (float): Y coordinate in millimeters from grid selector
+        x_target, y_target (Target): targets already converted by Coordinates.many()
     """
 
-    def __init__(self, x, y):
-        # Convert mm to steps (X,Y 8000 steps per mm)
-        self.x_step = -int(x * 8000)
-        self.y_step = -int(y * 8000)
+    def __init__(self, x, y, x_target=None, y_target=None):
+        # Convert mm to (Position, uPosition), exact to the microstep (X,Y 8000 steps per mm)
+        self.x_target = x_target if x_target is not None else AXES["x"].to_target(x)
+        self.y_target = y_target if y_target is not None else AXES["y"].to_target(y)
+        # the same targets in steps, for distances and display
+        self.x_step = self.x_target.steps
+        self.y_step = self.y_target.steps
         #  (Z 4000 steps per mm)
         self.z_top_step = 60000
         self.z_bottom_step = -12400
 
+        # Blended motion parameters in steps
+        # Z height above which the end effector clears everything when XY moves
+        self.z_safe_clearance_step = 40000
+        # XY distance from the target inside which Z may already start descending
+        self.xy_keep_out_step = 8000
+
         # Disc Loading Position parameters in steps
         self.x_disc_load_step = 296000
         self.y_disc_load_step = -184000
         self.z_disc_load_step = self.z_bottom_step + 2000
+
+    @classmethod
+    def many(cls, points):
+        """Coordinates for a list of (x, y) in millimeters, converted in one batch per axis"""
+        x_targets = AXES["x"].to_targets([x for x, _ in points])
+        y_targets = AXES["y"].to_targets([y for _, y in points])
+        return [cls(x, y, x_target, y_target) for (x, y), x_target, y_target in zip(points, x_targets, y_targets)]
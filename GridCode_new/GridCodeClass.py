@@ -23,6 +23,39 @@ def get_grid_square_from_markings(x_markings, x_shape, y_markings, y_shape):
     return row, col
 
 
+class OutOfBoundsError(ValueError):
+    """The selected grid square is outside the circle"""
+
+
+def get_placement_coordinates(x_markings, x_shape, y_markings, y_shape, delta_x, delta_y):
+    """
+    Resolve axis markings and a delta inside the grid square to global coordinates.
+
+    Returns:
+        (row, col, x_global, y_global) with the global coordinates in µm
+    Raises:
+        ValueError on invalid input, OutOfBoundsError if the square is outside the circle
+    """
+    if x_shape not in ["square", "circle"] or y_shape not in ["square", "circle"]:
+        raise ValueError("Invalid shape selection")
+
+    # Check if deltas are in a grid square
+    if delta_x > (spacing + line_thickness) or delta_y > (spacing + line_thickness):
+        raise ValueError("Delta out of scope!")
+
+    row, col = get_grid_square_from_markings(x_markings, x_shape, y_markings, y_shape)
+    x, y = get_coordinates(row, col)
+
+    # Check if the bottom-left corner is inside the circle
+    if x ** 2 + y ** 2 > circle_radius ** 2:
+        raise OutOfBoundsError("The selected grid square is outside the circle!")
+
+    # Desired placement coordinates on grid
+    x_tag = x + delta_x
+    y_tag = y + delta_y
+    return row, col, circle_global_coordinates[0] + x_tag, circle_global_coordinates[1] + y_tag
+
+
 class GridSelector:
     def __init__(self, callback_function=None, parent=None):
         self.callback_function = callback_function
@@ -52,37 +85,22 @@ class GridSelector:
             delta_x = int(self.delta_x_entry.get())
             delta_y = int(self.delta_y_entry.get())
 
-            if x_shape not in ["square", "circle"] or y_shape not in ["square", "circle"]:
-                raise ValueError("Invalid shape selection")
-
-            # Check if deltas are in a grid square
-            if delta_x > (spacing + line_thickness) or delta_y > (spacing + line_thickness):
-                raise ValueError("Delta out of scope!")
-
-            row, col = get_grid_square_from_markings(x_markings, x_shape, y_markings, y_shape)
-            x, y = get_coordinates(row, col)
-
-            # Check if the bottom-left corner is inside the circle
-            if x ** 2 + y ** 2 <= circle_radius ** 2:
-                # Desired placement coordinates on grid
-                x_tag = x + delta_x
-                y_tag = y + delta_y
-                self.x_global = circle_global_coordinates[0] + x_tag
-                self.y_global = circle_global_coordinates[1] + y_tag
+            row, col, self.x_global, self.y_global = get_placement_coordinates(
+                x_markings, x_shape, y_markings, y_shape, delta_x, delta_y)
 
-                messagebox.showinfo("Grid Square Selected",
-                                    f"Selected grid square:\nRow: {row}, Column: {col}\n\n"
-                                    f"Coordinates of desired point: \nX: {self.x_global * 10 ** -3: .3f} [mm]\nY: "
-                                    f" {self.y_global * 10 ** -3: .3f} [mm]")
+            messagebox.showinfo("Grid Square Selected",
+                                f"Selected grid square:\nRow: {row}, Column: {col}\n\n"
+                                f"Coordinates of desired point: \nX: {self.x_global * 10 ** -3: .3f} [mm]\nY: "
+                                f" {self.y_global * 10 ** -3: .3f} [mm]")
 
-                # Call the callback function if provided
-                if self.callback_function:
-                    self.callback_function(self.x_global, self.y_global)
+            # Call the callback function if provided
+            if self.callback_function:
+                self.callback_function(self.x_global, self.y_global)
 
-                self.cleanup()
+            self.cleanup()
 
-            else:
-                messagebox.showwarning("Out of Bounds", "The selected grid square is outside the circle!")
+        except OutOfBoundsError as e:
+            messagebox.showwarning("Out of Bounds", str(e))
         except ValueError as e:
             messagebox.showerror("Input Error", f"Invalid input: {e}")
 
@@ -1,16 +1,7 @@
-import os
-import sys
-
-try:
-    import libximc.highlevel as ximc
-except ImportError:
-    cur_dir = os.path.abspath(os.path.dirname(__file__))
-    ximc_dir = os.path.join(cur_dir, "..", "ximc")
-    ximc_package_dir = os.path.join(ximc_dir, "crossplatform", "wrappers", "python")
-    sys.path.append(ximc_package_dir)
-    import libximc.highlevel as ximc
-
-    print("Success!")
+from axis_registry import AXIS_MAP_FILE, AxisRegistry
+from device_discovery import discover_devices, probe
+from settings_cache import settings_cache
+from ximc_import import ximc, _check_result
 
 
 def axis_status(axis: ximc.Axis) -> None:
@@ -31,54 +22,95 @@ def axis_position(axis: ximc.Axis) -> 'tuple':
 
 def get_speed(axis: ximc.Axis) -> int:
     print("\nGet speed")
-    move_settings = axis.get_move_settings()
+    move_settings = settings_cache(axis._device_id).get("move_settings")
     return move_settings.Speed
 
 
 def set_speed(axis: ximc.Axis, speed: int) -> None:
     print("\nSet speed ")
-    move_settings = axis.get_move_settings()
+    # the settings cache reads move_settings once and skips the write if the speed is unchanged
+    cache = settings_cache(axis._device_id)
+    move_settings = cache.get("move_settings")
     print("The speed was equal to {0}. We will change it to {1}".format(move_settings.Speed, speed))
     move_settings.Speed = speed
-    axis.set_move_settings(move_settings)
+    _check_result(cache.set("move_settings", move_settings))
 
 
 enum_flags = ximc.EnumerateFlags.ENUMERATE_PROBE | ximc.EnumerateFlags.ENUMERATE_NETWORK
 
 enum_hints = "addr="
 
-devices_unsorted = ximc.enumerate_devices(enum_flags, enum_hints)
-devices = sorted(devices_unsorted, key=lambda d: d["ControllerName"])
-
-if len(devices) == 0:
-    print("The devices were not found.")
-else:
-    # Print devices list
-    print("Found {} device(s):".format(len(devices)))
-
-open_names = []
-
-if len(sys.argv) > 1:
-    open_names.append(sys.argv[1])
-elif len(devices) > 0:
-    for device in devices:
-        open_names.append(device["uri"])
-# print(open_names)
-
-# ******************************************** #
-#              Create axis object              #
-# ******************************************** #
-# Axis is the main libximc.highlevel class. It allows you to interact with the device.
-# Axis takes one argument - URI of the device
-axes = []  # List to store all Axis objects
-
-for open_name in open_names:
-    ax = ximc.Axis(open_name)
-    print("\nOpening device " + ax.uri)
-    axes.append(ax)
-
-axis1, axis2, axis3 = axes[:3] if len(axes) > 2 else None
+registry = None  # AxisRegistry, set by initialize_axes()
+explicit_registry = False  # True once use_registry() bound the roles, never rebound or saved then
+axes = {}  # Dict of role -> Axis object
+
+
+def _bind_axes():
+    """Binds X, Y and Z to controllers, enumerating devices only when the axis map is not enough"""
+    # The axis map ties every role to a controller serial number and stage name.
+    # When all mapped URIs answer, no enumeration is needed at all.
+    bound = AxisRegistry.from_file()
+
+    if bound is None or not bound.has_all_uris() or \
+            not all(probe(binding.uri) for binding in bound.bindings.values()):
+        # Devices found on the last run are opened directly, enumeration only runs when one of them is gone
+        devices_unsorted, refresh = discover_devices(enum_flags, enum_hints)
+        if refresh is not None and len(devices_unsorted) < 3:
+            devices_unsorted = refresh.result()
+        devices = sorted(devices_unsorted, key=lambda d: d["ControllerName"])
+
+        if len(devices) == 0:
+            print("The devices were not found.")
+        else:
+            # Print devices list
+            print("Found {} device(s):".format(len(devices)))
+
+        if bound is None:
+            # First run: bind by ControllerName order and keep the map for the next runs
+            bound = AxisRegistry.from_devices(devices)
+            if len(devices) >= 3:
+                bound.save()
+                print("Axis map written to {}. Check that the X, Y and Z roles are right.".format(AXIS_MAP_FILE))
+        else:
+            bound.update_uris(devices)
+            bound.save()
+    return bound
 
 
 def initialize_axes():
-    return axis1, axis2, axis3
+    """
+    Returns the X, Y and Z axes (not opened yet), None for a role without a controller.
+    Controllers are bound on the first call (again on later calls while a role is missing),
+    importing this module does not touch the hardware.
+    """
+    global registry
+    if registry is None or (len(axes) < 3 and not explicit_registry):
+        registry = _bind_axes()
+        axes.clear()
+        # ******************************************** #
+        #              Create axis object              #
+        # ******************************************** #
+        # Axis is the main libximc.highlevel class. It allows you to interact with the device.
+        # Axis takes one argument - URI of the device
+        axes.update(registry.create_axes())
+    return axes.get("x"), axes.get("y"), axes.get("z")
+
+
+def use_registry(bound):
+    """
+    Binds the roles to the controllers of an AxisRegistry instead of the axis map (e.g. xi-emu
+    controllers or URIs given on the command line). Such a registry is never rebound or saved.
+    """
+    global registry, explicit_registry
+    registry = bound
+    explicit_registry = True
+    axes.clear()
+    axes.update(registry.create_axes())
+
+
+def open_axes(*opened):
+    """Opens the given axes in parallel and checks that each one is the controller bound to its role"""
+    roles = {axis: role for role, axis in axes.items()}
+    for axis in opened:
+        print("\nOpening device " + axis.uri)
+    registry.open_axes({roles[axis]: axis for axis in opened})
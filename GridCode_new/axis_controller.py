@@ -1,6 +1,14 @@
-from axesInitializer import initialize_axes, axis_position
+from connection_manager import ConnectionManager
+from jog_input import open_jog_input
+from motion_engine import MotionEngine
+from telemetry import TelemetryRecorder
+import threading
 import time
-import keyboard
+
+# manual control key -> (axis, direction of the jog)
+JOG_KEYS = {"left": ("x", -1), "right": ("x", 1), "up": ("y", 1), "down": ("y", -1), "+": ("z", 1), "-": ("z", -1)}
+# length of a jog move in steps, a released key soft-stops the axis long before
+JOG_STEPS = 400000
 
 
 class AxisController:
@@ -9,75 +17,132 @@ class AxisController:
     Provides convenient access to individual axes and bulk operations.
     """
 
-    def __init__(self):
-        self.axes = initialize_axes()
+    def __init__(self, blended_motion=False, sync_xy=False, linear_xy=False, telemetry_path=None):
+        self.connections = ConnectionManager()
+        self.connections.on_reopen(self._axis_reopened)
         self.is_manual_mode = False
+        self._engine = None
+        self.telemetry = None
+        # overlap the Z and XY legs of placement moves (see MotionEngine.move_blended)
+        self.blended_motion = blended_motion
+        # start Y from X's sync output (X SYNC OUT must be wired to Y SYNC IN)
+        self.sync_xy = sync_xy
+        # scale X/Y speed and acceleration so XY moves follow a straight line
+        self.linear_xy = linear_xy
+        # telemetry log recorded from the moment the engine exists, None for none
+        self.telemetry_path = telemetry_path
+        # phase_hook(phase, start, end) is called after every leg of a placement (perf_counter times)
+        self.phase_hook = None
+        # jog_input(callback) starts the key event source of manual mode, callback(key, pressed)
+        self.jog_input = open_jog_input
+        self._manual_exit = threading.Event()
+        self._print_request = threading.Event()
+        # axis name -> future of the last jog move, cancelled on key release
+        self._jog_moves = {}
 
     @property
     def x_axis(self):
-        """Returns the X-axis (axis1) """
-        return self.axes[0]
+        """Returns the X-axis (axis1), opened on first use """
+        return self.connections.get("x")
 
     @property
     def y_axis(self):
-        """Returns the Y-axis (axis2)"""
-        return self.axes[1]
+        """Returns the Y-axis (axis2), opened on first use"""
+        return self.connections.get("y")
 
     @property
     def z_axis(self):
-        """Returns the Z-axis (axis3)"""
-        return self.axes[2]
+        """Returns the Z-axis (axis3), opened on first use"""
+        return self.connections.get("z")
+
+    @property
+    def engine(self):
+        """Returns the MotionEngine, opening all axes on first use"""
+        if self._engine is None:
+            # the engine needs the device handles, which only exist once the axes are open
+            self._engine = MotionEngine(*self.connections.open_all())
+            if self.sync_xy:
+                self._engine.enable_sync_start()
+            self._engine.linear_xy = self.linear_xy
+            if self.telemetry_path:
+                self.start_telemetry(self.telemetry_path)
+        return self._engine
 
     def open_all(self):
-        """Opens all axis devices"""
-        for axis in self.axes:
-            axis.open_device()
+        """Starts connecting to the axis devices in the background, returns immediately"""
+        self.connections.start()
+
+    def check_connections(self):
+        """Pings every open axis and reopens the ones that stopped answering"""
+        return self.connections.check_all()
+
+    def _axis_reopened(self, role, axis):
+        if self._engine is not None:
+            self._engine.rebind(role, axis)
+
+    def start_telemetry(self, path, rate_hz=100):
+        """Starts recording status, chart data and measurements of all axes to a binary log"""
+        self.stop_telemetry()
+        self.telemetry = TelemetryRecorder(self.engine.device_ids, path, rate_hz)
+        self.telemetry.start()
+
+    def stop_telemetry(self):
+        if self.telemetry is not None:
+            self.telemetry.stop()
+            self.telemetry = None
 
     def close_all(self):
         """Closes all axis devices"""
-        for axis in self.axes:
-            axis.close_device()
+        self.stop_telemetry()
+        if self._engine is not None:
+            self._engine.shutdown()
+            self._engine = None
+        self.telemetry = None
+        self.connections.close_all()
 
     def print_all_positions(self):
-        """Prints the current position of all axes"""
-        print("\nX-axis position:")
-        axis_position(self.x_axis)
-        print("\nY-axis position:")
-        axis_position(self.y_axis)
-        print("\nZ-axis position:")
-        axis_position(self.z_axis)
+        """Prints the current position of all axes, read through the axis queues so queued moves never delay it"""
+        for name, status in self.engine.read_status().items():
+            print("\n{}-axis position:".format(name.upper()))
+            print("Position: {0} steps, {1} Micro-steps".format(status.CurPosition, status.uCurPosition))
+
+    def _leg(self, phase, move):
+        """Runs one leg of a placement to completion and reports its timing to phase_hook"""
+        start = time.perf_counter()
+        result = move()
+        if hasattr(result, "result"):
+            result = result.result()
+        if self.phase_hook is not None:
+            self.phase_hook(phase, start, time.perf_counter())
+        return result
 
     def place_disc(self, coordinates):
-        self.z_axis.command_move(coordinates.z_top_step, 0)
-        self.z_axis.command_wait_for_stop(100)
-        self.x_axis.command_move(coordinates.x_step, 0)
-        self.y_axis.command_move(coordinates.y_step, 0)
-        self.x_axis.command_wait_for_stop(100)
-        self.y_axis.command_wait_for_stop(100)
-        self.z_axis.command_move(coordinates.z_bottom_step, 0)
-        self.z_axis.command_wait_for_stop(100)
+        if self.blended_motion:
+            self._leg("blended_move", lambda: self.engine.move_blended(
+                coordinates.x_target, coordinates.y_target, coordinates.z_top_step, coordinates.z_bottom_step,
+                coordinates.z_safe_clearance_step, coordinates.xy_keep_out_step))
+            return
+        self._leg("z_lift", lambda: self.engine.move_xyz(z=coordinates.z_top_step))
+        self._leg("xy_traverse", lambda: self.engine.move_xy(coordinates.x_target, coordinates.y_target))
+        self._leg("z_descend", lambda: self.engine.move_xyz(z=coordinates.z_bottom_step))
 
     def disc_load_position(self, coordinates):
-        self.z_axis.command_move(coordinates.z_top_step, 0)
-        self.z_axis.command_wait_for_stop(100)
-        self.x_axis.command_move(coordinates.x_disc_load_step, 0)
-        self.y_axis.command_move(coordinates.y_disc_load_step, 0)
-        self.x_axis.command_wait_for_stop(100)
-        self.y_axis.command_wait_for_stop(100)
-        self.z_axis.command_move(coordinates.z_disc_load_step, 0)
-        self.z_axis.command_wait_for_stop(100)
+        if self.blended_motion:
+            self._leg("blended_move", lambda: self.engine.move_blended(
+                coordinates.x_disc_load_step, coordinates.y_disc_load_step, coordinates.z_top_step,
+                coordinates.z_disc_load_step, coordinates.z_safe_clearance_step, coordinates.xy_keep_out_step))
+            return
+        self._leg("z_lift", lambda: self.engine.move_xyz(z=coordinates.z_top_step))
+        self._leg("xy_traverse", lambda: self.engine.move_xy(coordinates.x_disc_load_step,
+                                                             coordinates.y_disc_load_step))
+        self._leg("z_descend", lambda: self.engine.move_xyz(z=coordinates.z_disc_load_step))
 
     def home_xy(self):
-        self.z_axis.command_movr(20*4000, 0)     # so end effector won't hit something
-        self.z_axis.command_wait_for_stop(100)
-        self.x_axis.command_home()
-        self.y_axis.command_home()
-        self.x_axis.command_wait_for_stop(100)
-        self.y_axis.command_wait_for_stop(100)
+        self.engine.movr_xyz(dz=20*4000).result()     # so end effector won't hit something
+        self.engine.home_xyz(x=True, y=True).result()
 
     def home_z(self):
-        self.z_axis.command_home()
-        self.z_axis.command_wait_for_stop(100)
+        self.engine.home_xyz(z=True).result()
 
     def set_zero_x(self):
         self.x_axis.command_zero()
@@ -92,8 +157,12 @@ class AxisController:
         self.z_axis.command_wait_for_stop(100)
 
     def start_manual_control(self):
-        """Start keyboard control mode"""
+        """Start keyboard control mode, returns once ESC is pressed"""
+        engine = self.engine
+        # jogging uses the controllers' own settings, not the ones of the last linear XY move
+        engine.restore_move_settings()
         self.is_manual_mode = True
+        self._manual_exit.clear()
         print("Manual control activated!")
         print("  Controls:")
         print("  Left/Right arrows: X axis")
@@ -103,91 +172,57 @@ class AxisController:
         print("  P: Print current positions")
         print()
 
-        # Track which keys were pressed in the previous loop
-        prev_keys = {
-            'left': False, 'right': False, 'up': False, 'down': False,
-            'plus': False, 'minus': False
-        }
-        relative_steps = -400000
-
+        printer = threading.Thread(target=self._print_positions_on_request, name="jog-positions", daemon=True)
+        printer.start()
+        source = self.jog_input(self._on_jog_key)
+        try:
+            # short waits so Ctrl+C still gets through
+            while not self._manual_exit.wait(0.1):
+                pass
+        except KeyboardInterrupt:
+            pass
+        finally:
+            source.stop()
+            self.stop_manual_control()
+            printer.join()
+
+    def _on_jog_key(self, key, pressed):
+        """Runs on the input thread: only queues commands, never waits for a controller"""
+        if key in JOG_KEYS:
+            name, direction = JOG_KEYS[key]
+            axis_queue = self.engine.queues[name]
+            if pressed:
+                command = self._jog_moves[name] = axis_queue.movr(direction * JOG_STEPS)
+            else:
+                # a jog move still waiting in the queue must never start after the release;
+                # the soft stop cancels it, or runs right after it if it is already being sent
+                move = self._jog_moves.pop(name, None)
+                if move is not None:
+                    move.cancel()
+                command = axis_queue.sstp()
+            command.add_done_callback(self._report_jog_error)
+        elif key == "p" and pressed:
+            self._print_request.set()
+        elif key == "esc" and pressed:
+            self._manual_exit.set()
+
+    @staticmethod
+    def _report_jog_error(command):
+        if not command.cancelled() and command.exception() is not None:
+            print("\nJog command failed: {}".format(command.exception()))
+
+    def _print_positions_on_request(self):
+        """Prints the positions whenever P was pressed, away from the input thread"""
         while self.is_manual_mode:
-            try:
-                # Current key states
-                current_keys = {
-                    'left': keyboard.is_pressed('left'),
-                    'right': keyboard.is_pressed('right'),
-                    'up': keyboard.is_pressed('up'),
-                    'down': keyboard.is_pressed('down'),
-                    'plus': keyboard.is_pressed('+') or keyboard.is_pressed('='),
-                    'minus': keyboard.is_pressed('-')
-                }
-
-                # X-axis control
-                if current_keys['left'] and not prev_keys['left']:
-                    # Just started pressing left
-                    self.x_axis.command_movr(relative_steps, 0)
-                elif not current_keys['left'] and prev_keys['left']:
-                    # Just released left
-                    self.x_axis.command_sstp()
-
-                if current_keys['right'] and not prev_keys['right']:
-                    # Just started pressing right
-                    self.x_axis.command_movr(-relative_steps, 0)
-                elif not current_keys['right'] and prev_keys['right']:
-                    # Just released right
-                    self.x_axis.command_sstp()
-
-                # Y-axis control
-                if current_keys['up'] and not prev_keys['up']:
-                    # Just started pressing up
-                    self.y_axis.command_movr(-relative_steps, 0)
-                elif not current_keys['up'] and prev_keys['up']:
-                    # Just released up
-                    self.y_axis.command_sstp()
-
-                if current_keys['down'] and not prev_keys['down']:
-                    # Just started pressing down
-                    self.y_axis.command_movr(relative_steps, 0)
-                elif not current_keys['down'] and prev_keys['down']:
-                    # Just released down
-                    self.y_axis.command_sstp()
-
-                # Z-axis control
-                if current_keys['plus'] and not prev_keys['plus']:
-                    # Just started pressing +
-                    self.z_axis.command_movr(-relative_steps, 0)
-                elif not current_keys['plus'] and prev_keys['plus']:
-                    # Just released +
-                    self.z_axis.command_sstp()
-
-                if current_keys['minus'] and not prev_keys['minus']:
-                    # Just started pressing -
-                    self.z_axis.command_movr(relative_steps, 0)
-                elif not current_keys['minus'] and prev_keys['minus']:
-                    # Just released -
-                    self.z_axis.command_sstp()
-
-                # Other controls
-                if keyboard.is_pressed('p'):
-                    self.print_all_positions()
-                    time.sleep(0.3)  # Longer delay for position printing
-
-                if keyboard.is_pressed('esc'):
-                    self.stop_manual_control()
-
-                # Update previous key states
-                prev_keys = current_keys.copy()
-
-                time.sleep(0.05)  # Small delay to prevent excessive CPU usage
-
-            except KeyboardInterrupt:
-                self.stop_manual_control()
+            if self._print_request.wait(0.1):
+                self._print_request.clear()
+                self.print_all_positions()
 
     def stop_manual_control(self):
         """Stop keyboard control mode and stop all axes"""
         self.is_manual_mode = False
-        # Stop all axes when exiting manual mode
-        self.x_axis.command_sstp()
-        self.y_axis.command_sstp()
-        self.z_axis.command_sstp()
+        self._manual_exit.set()
+        # Stop all axes when exiting manual mode; the stops also cancel jog moves still queued
+        self._jog_moves.clear()
+        self.engine.stop_all()
         print("\nManual control deactivated! All axes stopped.")
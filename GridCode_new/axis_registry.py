@@ -0,0 +1,134 @@
+import json
+import os
+from concurrent.futures import ThreadPoolExecutor
+
+from ximc_import import ximc
+
+AXIS_MAP_FILE = os.path.join(os.path.abspath(os.path.dirname(__file__)), "axis_map.json")
+ROLES = ("x", "y", "z")
+
+
+class AxisBinding:
+    """
+    Ties an axis role to one controller.
+
+    Args:
+        role (str): "x", "y" or "z"
+        serial (int): controller serial number (get_serial_number), None to skip the check
+        stage_name (str): PositionerName stored in the controller (get_stage_name), None to skip the check
+        uri (str): last known URI of the controller
+        profile (str): name of the stage profile in the profile library the controller must hold, None for any
+        correction_table (str): libximc correction table file of the stage (relative to the axis map), None for none
+    """
+
+    def __init__(self, role, serial=None, stage_name=None, uri=None, profile=None, correction_table=None):
+        self.role = role
+        self.serial = serial
+        self.stage_name = stage_name
+        self.uri = uri
+        self.profile = profile
+        self.correction_table = correction_table
+
+    def to_dict(self):
+        entry = {"serial": self.serial, "stage_name": self.stage_name, "uri": self.uri}
+        if self.profile:
+            entry["profile"] = self.profile
+        if self.correction_table:
+            entry["correction_table"] = self.correction_table
+        return entry
+
+
+class AxisRegistry:
+    """
+    Maps axis roles to controllers by serial number and stage name.
+
+    The map is kept in axis_map.json:
+        {"x": {"serial": 12345, "stage_name": "8MT200-150", "uri": "xi-com:/dev/ttyACM0",
+               "profile": "8MT200_150_BS1_R_BR_MEn1"}, ...}
+    Once every role has a URI no enumeration is needed. Each controller is checked
+    against its serial and stage name when it is opened, so a renumbered port can
+    never silently swap two axes. The optional profile names the stage profile (see
+    profile_compiler) the controller is checked against after connecting, the optional
+    correction_table a libximc correction table file (see correction_table) measured
+    for the stage.
+    """
+
+    def __init__(self, bindings):
+        self.bindings = {binding.role: binding for binding in bindings}
+
+    @classmethod
+    def from_file(cls, path=AXIS_MAP_FILE):
+        """Reads the map, returns None if there is no map file"""
+        if not os.path.exists(path):
+            return None
+        with open(path) as f:
+            entries = json.load(f)
+        unknown = set(entries) - set(ROLES)
+        if unknown:
+            raise ValueError("Unknown axis role(s) {} in {}".format(sorted(unknown), path))
+        return cls([AxisBinding(role, entry.get("serial"), entry.get("stage_name"), entry.get("uri"),
+                                entry.get("profile"), entry.get("correction_table"))
+                    for role, entry in entries.items()])
+
+    @classmethod
+    def from_devices(cls, devices):
+        """Binds X, Y, Z to the first three devices of an enumerate_devices() list"""
+        return cls([AxisBinding(role, device.get("device_serial"), device.get("PositionerName"), device["uri"])
+                    for role, device in zip(ROLES, devices)])
+
+    def save(self, path=AXIS_MAP_FILE):
+        with open(path, "w") as f:
+            json.dump({role: binding.to_dict() for role, binding in self.bindings.items()}, f, indent=2)
+
+    def has_all_uris(self, roles=ROLES):
+        return all(role in self.bindings and self.bindings[role].uri for role in roles)
+
+    def update_uris(self, devices):
+        """Takes the current URI of every bound serial from an enumerate_devices() list"""
+        by_serial = {device.get("device_serial"): device["uri"] for device in devices}
+        for binding in self.bindings.values():
+            if binding.serial in by_serial:
+                binding.uri = by_serial[binding.serial]
+
+    def create_axes(self, roles=ROLES):
+        """Returns {role: unopened ximc.Axis} for the bound roles that have a URI"""
+        return {role: ximc.Axis(self.bindings[role].uri) for role in roles
+                if role in self.bindings and self.bindings[role].uri}
+
+    def validate(self, role, axis):
+        """Raises RuntimeError if the opened axis is not the controller bound to role"""
+        binding = self.bindings[role]
+        if binding.serial is not None:
+            serial = axis.get_serial_number()
+            if serial != binding.serial:
+                raise RuntimeError("{} axis at {} has serial {}, expected {}"
+                                   .format(role.upper(), axis.uri, serial, binding.serial))
+        if binding.stage_name:
+            stage_name = axis.get_stage_name().PositionerName
+            if stage_name != binding.stage_name:
+                raise RuntimeError("{} axis at {} is stage '{}', expected '{}'"
+                                   .format(role.upper(), axis.uri, stage_name, binding.stage_name))
+
+    def open_axes(self, axes):
+        """
+        Opens and validates {role: ximc.Axis} in parallel, one thread per device.
+        On any failure every axis opened here is closed again and the first error is raised.
+        """
+        def open_one(role):
+            axis = axes[role]
+            axis.open_device()
+            try:
+                self.validate(role, axis)
+            except Exception:
+                axis.close_device()
+                raise
+
+        if not axes:
+            return
+        with ThreadPoolExecutor(max_workers=len(axes)) as pool:
+            futures = {role: pool.submit(open_one, role) for role in axes}
+        errors = [future.exception() for future in futures.values() if future.exception() is not None]
+        if errors:
+            for axis in axes.values():
+                axis.close_device()
+            raise errors[0]
@@ -0,0 +1,97 @@
+import csv
+import json
+import os
+import threading
+
+from GridCodeClass import get_placement_coordinates
+from CoordinateClass import Coordinates
+from unit_conversion import exact
+
+
+def load_targets(path):
+    """
+    Reads a list of placement targets from a CSV or JSON file.
+
+    Every target has the same inputs as the grid selector window:
+        x_markings, y_markings (int): number of marks on the axis (1-6)
+        x_shape, y_shape (str): "square" or "circle"
+        delta_x, delta_y (int): point inside the grid square in µm (default 0)
+
+    CSV files need a header row with these names, JSON files hold a list of objects.
+    """
+    if os.path.splitext(path)[1].lower() == ".json":
+        with open(path) as f:
+            rows = json.load(f)
+    else:
+        with open(path, newline="") as f:
+            rows = list(csv.DictReader(f))
+
+    targets = []
+    for number, row in enumerate(rows, start=1):
+        try:
+            targets.append({
+                "x_markings": int(row["x_markings"]),
+                "x_shape": str(row["x_shape"]).strip(),
+                "y_markings": int(row["y_markings"]),
+                "y_shape": str(row["y_shape"]).strip(),
+                "delta_x": int(row.get("delta_x") or 0),
+                "delta_y": int(row.get("delta_y") or 0),
+            })
+        except (KeyError, TypeError, ValueError) as e:
+            raise ValueError(f"Target {number} in {path} is invalid: {e}")
+    return targets
+
+
+def resolve_targets(targets):
+    """Converts targets from load_targets() into Coordinates, in the same order"""
+    points = []
+    for number, target in enumerate(targets, start=1):
+        try:
+            _, _, x_global, y_global = get_placement_coordinates(**target)
+        except ValueError as e:
+            raise ValueError(f"Target {number}: {e}")
+        # µm -> mm, as returned by GridSelector.get_final_coordinates_mm, kept exact
+        points.append((exact(x_global) / 10 ** 3, exact(y_global) / 10 ** 3))
+    return Coordinates.many(points)
+
+
+class BatchRunner:
+    """
+    Places discs at a whole list of coordinates back to back on a worker thread.
+
+    Args:
+        control (AxisController): opened axis controller
+        coordinates (list): Coordinates to place, in order
+    """
+
+    def __init__(self, control, coordinates):
+        self.control = control
+        self.coordinates = list(coordinates)
+        self.placed = 0
+        self.error = None
+        self._stop_requested = threading.Event()
+        self._thread = threading.Thread(target=self._run, name="batch-runner", daemon=True)
+
+    def start(self):
+        self._thread.start()
+
+    def stop(self):
+        """Stops the batch after the placement in progress"""
+        self._stop_requested.set()
+
+    def join(self):
+        self._thread.join()
+
+    def _run(self):
+        total = len(self.coordinates)
+        try:
+            for coordinates in self.coordinates:
+                if self._stop_requested.is_set():
+                    print(f"Batch stopped after {self.placed}/{total} placements")
+                    return
+                self.control.place_disc(coordinates)
+                self.placed += 1
+                print(f"Placed disc {self.placed}/{total} at X: {coordinates.x_step} Y: {coordinates.y_step} [steps]")
+        except Exception as e:
+            self.error = e
+            print(f"Batch aborted after {self.placed}/{total} placements: {e}")
@@ -0,0 +1,219 @@
+import argparse
+import atexit
+import struct
+import threading
+import time
+from multiprocessing import resource_tracker, shared_memory
+
+from ximc_import import ll, _highlevel
+
+SHARED_MEMORY_NAME = "gridcode_ximc_stats"
+
+# Shared memory layout (little endian):
+#   header: magic, version, number of slots, slots in use
+#   slot:   function name, device_t (-1 for calls without a device), calls, total ns, max ns,
+#           result counts (Ok, Error, NotImplemented, ValueError, NoDevice, other),
+#           latency histogram (bucket i counts calls of 2^(i-1) .. 2^i us, the last bucket everything slower)
+STATS_MAGIC = b"GCCS"
+STATS_VERSION = 1
+HEADER = struct.Struct("<4sHHI")
+RESULT_CODES = (ll.Result.Ok, ll.Result.Error, ll.Result.NotImplemented, ll.Result.ValueError, ll.Result.NoDevice)
+RESULT_NAMES = ("ok", "error", "not_implemented", "value_error", "no_device", "other")
+BUCKETS = 20
+SLOT = struct.Struct("<32siQQQ{}Q{}Q".format(len(RESULT_NAMES), BUCKETS))
+MAX_SLOTS = 1024
+
+
+def install_lib(lib):
+    """Makes the lowlevel and highlevel wrappers call lib instead of the libximc library object"""
+    ll.lib = lib
+    _highlevel.lib = lib
+
+
+def _bucket(ns):
+    return min(BUCKETS - 1, max(0, (ns // 1000).bit_length()))
+
+
+class InstrumentedLib:
+    """
+    Stands in for the libximc library object and measures every call: count, latency
+    histogram and result codes per function and device. The statistics are kept in a
+    named shared memory block, so `python call_stats.py top` can show them live from
+    another process while the application runs.
+
+    Args:
+        lib: libximc library object (ll.lib)
+        name (str): shared memory name
+    """
+
+    def __init__(self, lib, name=SHARED_MEMORY_NAME, max_slots=MAX_SLOTS):
+        self.lib = lib
+        self.name = name
+        self.max_slots = max_slots
+        size = HEADER.size + SLOT.size * max_slots
+        try:
+            self._memory = shared_memory.SharedMemory(name, create=True, size=size)
+        except FileExistsError:
+            # left over from a process that did not shut down cleanly
+            stale = shared_memory.SharedMemory(name)
+            stale.close()
+            stale.unlink()
+            self._memory = shared_memory.SharedMemory(name, create=True, size=size)
+        self._slots = {}
+        self._values = []
+        self._lock = threading.Lock()
+        HEADER.pack_into(self._memory.buf, 0, STATS_MAGIC, STATS_VERSION, max_slots, 0)
+        atexit.register(self.close)
+
+    def __getattr__(self, name):
+        function = getattr(self.lib, name)
+        if not callable(function):
+            return function
+
+        def measured(*args):
+            start = time.perf_counter_ns()
+            result = function(*args)
+            elapsed = time.perf_counter_ns() - start
+            device_id = args[0] if args and isinstance(args[0], int) else -1
+            self._record(name, device_id, elapsed, result)
+            return result
+        # cache the wrapper, __getattr__ is only called for names not found on the instance
+        setattr(self, name, measured)
+        return measured
+
+    def _slot(self, name, device_id):
+        key = (name, device_id)
+        index = self._slots.get(key)
+        if index is None:
+            if len(self._slots) >= self.max_slots:
+                return None
+            index = self._slots[key] = len(self._values)
+            self._values.append([0, 0, 0] + [0] * len(RESULT_NAMES) + [0] * BUCKETS)
+            HEADER.pack_into(self._memory.buf, 0, STATS_MAGIC, STATS_VERSION, self.max_slots, len(self._slots))
+        return index
+
+    def _record(self, name, device_id, elapsed, result):
+        with self._lock:
+            index = self._slot(name, device_id)
+            if index is None or self._memory.buf is None:
+                return
+            values = self._values[index]
+            values[0] += 1
+            values[1] += elapsed
+            values[2] = max(values[2], elapsed)
+            code = RESULT_CODES.index(result) if result in RESULT_CODES else len(RESULT_CODES)
+            values[3 + code] += 1
+            values[3 + len(RESULT_NAMES) + _bucket(elapsed)] += 1
+            SLOT.pack_into(self._memory.buf, HEADER.size + index * SLOT.size, name.encode(), device_id, *values)
+
+    def close(self):
+        with self._lock:
+            if self._memory.buf is None:
+                return
+            self._memory.close()
+            try:
+                self._memory.unlink()
+            except FileNotFoundError:
+                pass
+
+
+def install(name=SHARED_MEMORY_NAME):
+    """Instruments every libximc call made through the lowlevel and highlevel wrappers"""
+    instrumented = InstrumentedLib(ll.lib, name)
+    install_lib(instrumented)
+    return instrumented
+
+
+def attach(name=SHARED_MEMORY_NAME):
+    """Attaches to the statistics of another process without taking ownership of the block"""
+    memory = shared_memory.SharedMemory(name)
+    # the resource tracker would otherwise unlink the block when this process exits
+    resource_tracker.unregister(memory._name, "shared_memory")
+    return memory
+
+
+def read_stats(memory):
+    """Returns one dict per (function, device) slot of an attached shared memory block"""
+    magic, version, _, used = HEADER.unpack_from(memory.buf, 0)
+    if magic != STATS_MAGIC or version != STATS_VERSION:
+        raise ValueError("Shared memory {} does not hold version {} call statistics".format(memory.name,
+                                                                                           STATS_VERSION))
+    stats = []
+    for index in range(used):
+        fields = SLOT.unpack_from(memory.buf, HEADER.size + index * SLOT.size)
+        name, device_id, calls, total_ns, max_ns = fields[:5]
+        if not calls:
+            continue
+        results = fields[5:5 + len(RESULT_NAMES)]
+        stats.append({
+            "function": name.rstrip(b"\0").decode(),
+            "device": device_id,
+            "calls": calls,
+            "total_ns": total_ns,
+            "max_ns": max_ns,
+            "results": dict(zip(RESULT_NAMES, results)),
+            "histogram": list(fields[5 + len(RESULT_NAMES):]),
+        })
+    return stats
+
+
+def histogram_percentile(histogram, p):
+    """Upper bound in us of the bucket holding the p-th percentile"""
+    rank = p / 100 * sum(histogram)
+    seen = 0
+    for bucket, count in enumerate(histogram):
+        seen += count
+        if count and seen >= rank:
+            return 2 ** bucket
+    return 0
+
+
+def top(name=SHARED_MEMORY_NAME, interval=1.0, rows=25):
+    """Prints the busiest libximc functions of a running instrumented process until Ctrl+C"""
+    memory = attach(name)
+    previous = {}
+    try:
+        while True:
+            stats = read_stats(memory)
+            stats.sort(key=lambda s: s["total_ns"], reverse=True)
+            lines = ["libximc calls ({})  {}".format(name, time.strftime("%H:%M:%S")),
+                     "{:<28} {:>6} {:>10} {:>8} {:>10} {:>9} {:>9} {:>9} {:>7}".format(
+                         "function", "device", "calls", "calls/s", "total ms", "mean us", "p99 us", "max us",
+                         "errors")]
+            for s in stats[:rows]:
+                key = (s["function"], s["device"])
+                rate = (s["calls"] - previous.get(key, s["calls"])) / interval
+                previous[key] = s["calls"]
+                errors = s["calls"] - s["results"]["ok"] - s["results"]["other"]
+                lines.append("{:<28} {:>6} {:>10} {:>8.1f} {:>10.1f} {:>9.1f} {:>9} {:>9.0f} {:>7}".format(
+                    s["function"][:28], s["device"] if s["device"] >= 0 else "-", s["calls"], rate,
+                    s["total_ns"] / 1e6, s["total_ns"] / s["calls"] / 1000,
+                    histogram_percentile(s["histogram"], 99), s["max_ns"] / 1000, errors))
+            # clear the terminal and redraw, like top
+            print("\033[2J\033[H" + "\n".join(lines), flush=True)
+            time.sleep(interval)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        memory.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Live view of the libximc call statistics of a running GridCode")
+    parser.add_argument("command", choices=["top", "dump"])
+    parser.add_argument("--name", default=SHARED_MEMORY_NAME, help="shared memory name")
+    parser.add_argument("--interval", type=float, default=1.0, help="refresh interval in seconds")
+    args = parser.parse_args()
+    if args.command == "top":
+        top(args.name, args.interval)
+    else:
+        memory = attach(args.name)
+        try:
+            for s in read_stats(memory):
+                print(s)
+        finally:
+            memory.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,148 @@
+import itertools
+import queue
+import threading
+import time
+from concurrent.futures import Future
+from ctypes import byref
+
+from settings_cache import settings_cache
+from ximc_import import ll, _check_result
+
+# queue priorities, lower runs first; equal priorities run in submission order
+STOP, STATUS, COMMAND = 0, 1, 2
+# read_status() reuses a status read less than this many seconds ago
+STATUS_MAX_AGE = 0.05
+
+
+class AxisQueue:
+    """
+    Issues the commands of one axis on a dedicated I/O thread.
+
+    submit() returns a concurrent.futures.Future immediately; the I/O thread runs the
+    queued calls back to back, so the caller never waits for the controller's
+    acknowledgement. A stop cancels every command queued before it that has not
+    started yet (their futures end up cancelled), so no move queued ahead of a stop
+    can run after it. The queue touches the USB link only for submitted calls.
+
+    read_status() puts a get_status between the queued commands: it runs right after
+    the command in progress, ahead of queued moves, so a status display never waits
+    for a queue of moves. Status reads are rate limited to one per STATUS_MAX_AGE.
+
+    Args:
+        device_ids (dict): axis name -> device_t handle (shared, a reopened axis is picked up)
+        name (str): axis name
+    """
+
+    def __init__(self, device_ids, name):
+        self.device_ids = device_ids
+        self.name = name
+        self._queue = queue.PriorityQueue()
+        self._sequence = itertools.count()
+        # futures of queued commands a stop has to cancel
+        self._pending = set()
+        self._lock = threading.Lock()
+        # status_t of the last read and when it was taken
+        self.latest_status = None
+        self._status_time = 0.0
+        # future of the status read in the queue, shared by everyone asking meanwhile
+        self._status_read = None
+        self._thread = threading.Thread(target=self._run, name="axis-queue-" + name, daemon=True)
+        self._thread.start()
+
+    def submit(self, function, *args, priority=COMMAND):
+        """Queues function(device_id, *args), returns a Future of its return value"""
+        future = Future()
+        if priority == STOP:
+            self._cancel_pending()
+        else:
+            with self._lock:
+                self._pending.add(future)
+            future.add_done_callback(self._discard)
+        self._queue.put((priority, next(self._sequence), function, args, future))
+        return future
+
+    def _discard(self, future):
+        with self._lock:
+            self._pending.discard(future)
+
+    def _cancel_pending(self):
+        """Cancels the queued commands; one the I/O thread is already running completes"""
+        with self._lock:
+            pending = list(self._pending)
+        for future in pending:
+            future.cancel()
+
+    def call(self, function_name, *args, priority=COMMAND):
+        """Queues a libximc function; the Future raises like _check_result on an error code"""
+        function = getattr(ll.lib, function_name)
+        return self.submit(lambda device_id, *a: _check_result(function(device_id, *a)), *args, priority=priority)
+
+    def move(self, position, uposition=0):
+        return self.call("command_move", int(position), int(uposition))
+
+    def movr(self, shift, ushift=0):
+        return self.call("command_movr", int(shift), int(ushift))
+
+    def home(self):
+        return self.call("command_home")
+
+    def stop(self):
+        """Immediate stop, cancels the commands still queued"""
+        return self.call("command_stop", priority=STOP)
+
+    def sstp(self):
+        """Soft stop, cancels the commands still queued"""
+        return self.call("command_sstp", priority=STOP)
+
+    def read_status(self, max_age=STATUS_MAX_AGE):
+        """
+        Reads status_t between the queued commands.
+
+        A status younger than max_age seconds is returned without a read, and callers
+        asking while a read is queued get that read's future.
+
+        Returns:
+            concurrent.futures.Future of status_t
+        """
+        with self._lock:
+            if self._status_read is not None:
+                return self._status_read
+            if self.latest_status is not None and time.perf_counter() - self._status_time < max_age:
+                future = Future()
+                future.set_result(self.latest_status)
+                return future
+            future = self._status_read = Future()
+        self._queue.put((STATUS, next(self._sequence), self._read_status, (), future))
+        return future
+
+    def _read_status(self, device_id):
+        status = ll.status_t()
+        try:
+            _check_result(ll.lib.get_status(device_id, byref(status)))
+            with self._lock:
+                self.latest_status = status
+                self._status_time = time.perf_counter()
+        finally:
+            with self._lock:
+                self._status_read = None
+        return status
+
+    def set_settings(self, block, settings):
+        """Writes a settings block through the settings cache"""
+        return self.submit(lambda device_id: _check_result(settings_cache(device_id).set(block, settings)))
+
+    def close(self):
+        """Runs what is queued, then stops the I/O thread"""
+        self._queue.put((COMMAND + 1, next(self._sequence), None, (), None))
+        self._thread.join()
+
+    def _run(self):
+        while True:
+            _, _, function, args, future = self._queue.get()
+            if function is None:
+                return
+            if future.set_running_or_notify_cancel():
+                try:
+                    future.set_result(function(self.device_ids[self.name], *args))
+                except Exception as e:
+                    future.set_exception(e)
@@ -0,0 +1,184 @@
+import threading
+import time
+from concurrent.futures import Future
+
+from fast_ximc import FastAxis
+from ximc_import import ll
+
+
+class _Watch:
+    """One pending completion: the axis, its target and predicted arrival (if known) and the future to resolve"""
+
+    def __init__(self, name, target, arrival, direction=None):
+        self.name = name
+        self.target = target
+        self.arrival = arrival
+        # set for position watches: +1 / -1, the side of target that resolves the watch
+        self.direction = direction
+        self.future = Future()
+        self.next_poll = 0.0
+
+
+class CompletionMonitor:
+    """
+    Detects the end of axis moves from a single background thread.
+
+    Every watched axis is polled with get_status until MVCMD_RUNNING clears. The polling
+    interval adapts to the move: when the caller predicts the move duration (see
+    TrajectoryEstimator) the axis is left alone until shortly before the predicted
+    arrival, checked only every max_sleep_ms to catch early stops. Without a prediction,
+    or once it has run out, the axis is polled coarsely while far from its target, and
+    once the estimated time of arrival (remaining distance / CurSpeed) falls inside the
+    fine window it is polled every fine_interval_ms. This keeps completion detection at
+    millisecond level without flooding the USB link.
+
+    Args:
+        device_ids (dict): axis name -> device_t handle
+        coarse_interval_ms (int): longest pause between two polls of a moving axis
+        fine_interval_ms (int): polling interval close to the arrival time
+        fine_window_ms (int): how long before the estimated arrival fine polling starts
+        default_interval_ms (int): interval used when the target is unknown (homing, relative moves)
+        max_sleep_ms (int): longest pause between two polls before the predicted arrival
+    """
+
+    def __init__(self, device_ids, coarse_interval_ms=50, fine_interval_ms=1, fine_window_ms=30,
+                 default_interval_ms=10, max_sleep_ms=250):
+        self.device_ids = device_ids
+        self.coarse_interval = coarse_interval_ms / 1000
+        self.fine_interval = fine_interval_ms / 1000
+        self.fine_window = fine_window_ms / 1000
+        self.default_interval = default_interval_ms / 1000
+        self.max_sleep = max_sleep_ms / 1000
+        # typed get_status with one reused status_t per axis
+        self._axes = {name: FastAxis(device_ids, name) for name in device_ids}
+        self._watches = []
+        self._condition = threading.Condition()
+        self._running = True
+        self._thread = threading.Thread(target=self._run, name="completion-monitor", daemon=True)
+        self._thread.start()
+
+    def watch(self, name, target=None, duration=None):
+        """
+        Starts watching an axis that has just been commanded to move.
+
+        Args:
+            name (str): axis name ("x", "y" or "z")
+            target (int): target position in steps, used to estimate the arrival time
+            duration (float): predicted move duration in seconds, counted from now
+
+        Returns:
+            concurrent.futures.Future resolving to the position at which the axis stopped.
+            Use add_done_callback on it to be notified from the monitor thread.
+        """
+        now = time.perf_counter()
+        arrival = None if duration is None else now + duration
+        watch = _Watch(name, target, arrival)
+        if arrival is not None:
+            watch.next_poll = now + self._predicted_sleep(arrival, now)
+        with self._condition:
+            self._watches.append(watch)
+            self._condition.notify()
+        return watch.future
+
+    def watch_position(self, name, threshold, direction):
+        """
+        Watches a moving axis until it passes a position.
+
+        Args:
+            name (str): axis name ("x", "y" or "z")
+            threshold (int): position in steps
+            direction (int): +1 to resolve once CurPosition >= threshold, -1 for <= threshold
+
+        Returns:
+            concurrent.futures.Future resolving to the position read when the threshold was
+            passed, or to the stop position if the axis stopped before reaching it.
+        """
+        watch = _Watch(name, threshold, None, direction)
+        with self._condition:
+            self._watches.append(watch)
+            self._condition.notify()
+        return watch.future
+
+    def _poll(self, watch, now):
+        """Reads the status of one watched axis, returns True when the watch is resolved"""
+        status = self._axes[watch.name].read_status()
+        passed = watch.direction is not None and (status.CurPosition - watch.target) * watch.direction >= 0
+        if passed or not status.MvCmdSts & ll.MvcmdStatus.MVCMD_RUNNING:
+            watch.future.set_result(status.CurPosition)
+            return True
+        watch.next_poll = now + self._next_interval(watch, status, now)
+        return False
+
+    def _predicted_sleep(self, arrival, now):
+        """How long to leave an axis alone before its predicted arrival"""
+        return min(self.max_sleep, max(0.0, arrival - self.fine_window - now))
+
+    def _next_interval(self, watch, status, now):
+        """Coarse while far from the target, fine once the estimated arrival is near"""
+        speed = abs(status.CurSpeed)
+        eta = None
+        if watch.target is not None and speed != 0:
+            eta = abs(watch.target - status.CurPosition) / speed
+        if watch.arrival is not None and now < watch.arrival - self.fine_window:
+            sleep = self._predicted_sleep(watch.arrival, now)
+            if eta is not None:
+                # the axis may be faster than predicted, trust whichever arrives first
+                sleep = min(sleep, max(self.fine_interval, eta - self.fine_window))
+            return sleep
+        if watch.target is None:
+            return self.default_interval
+        if eta is None:
+            # accelerating from rest or settling at the target
+            return self.fine_interval
+        if eta <= self.fine_window:
+            return self.fine_interval
+        return min(self.coarse_interval, eta - self.fine_window)
+
+    def _run(self):
+        while True:
+            with self._condition:
+                while self._running and not self._watches:
+                    self._condition.wait()
+                if not self._running:
+                    return
+                watches = list(self._watches)
+
+            now = time.perf_counter()
+            finished = []
+            for watch in watches:
+                if watch.future.cancelled():
+                    finished.append(watch)
+                    continue
+                if watch.next_poll > now:
+                    continue
+                try:
+                    if self._poll(watch, now):
+                        finished.append(watch)
+                except Exception as e:
+                    # also reached when the future was cancelled while polling
+                    if not watch.future.done():
+                        watch.future.set_exception(e)
+                    finished.append(watch)
+
+            with self._condition:
+                if not self._running:
+                    # stop() cancelled and cleared the watches while they were polled
+                    return
+                if finished:
+                    self._watches = [watch for watch in self._watches if watch not in finished]
+                if self._watches:
+                    wake_up = min(watch.next_poll for watch in self._watches)
+                    timeout = wake_up - time.perf_counter()
+                    if timeout > 0:
+                        # a new watch() call wakes the thread up early
+                        self._condition.wait(timeout)
+
+    def stop(self):
+        """Stops the monitor thread. Pending futures are cancelled."""
+        with self._condition:
+            self._running = False
+            for watch in self._watches:
+                watch.future.cancel()
+            self._watches.clear()
+            self._condition.notify()
+        self._thread.join()
@@ -0,0 +1,186 @@
+import os
+import threading
+from concurrent.futures import Future
+
+import axesInitializer
+from axesInitializer import initialize_axes, open_axes
+from axis_registry import AXIS_MAP_FILE
+from correction_table import CorrectionTable, set_device_table
+from profile_check import ensure_profiles
+from profile_compiler import PROFILE_LIBRARY_FILE, ProfileLibrary
+from settings_cache import forget
+
+ROLES = ("x", "y", "z")
+
+
+class ConnectionManager:
+    """
+    Keeps the connections to the X, Y and Z controllers.
+
+    Binding the roles to controllers (axis map / discovery) runs on a background thread
+    started by start(), so the GUI can come up while the hardware is negotiated. Each
+    axis is opened on first use. check() pings an axis with get_status and reopens it
+    when the controller no longer answers (result_nodevice), so a USB hiccup does not
+    need a program restart. Listeners registered with on_reopen() are told about the
+    new device handle.
+
+    Roles with a profile in the axis map are checked against the compiled profile
+    library (profiles.gcp) right after they are opened; only controllers whose
+    settings differ are touched. Roles with a correction table get it loaded into
+    libximc for their device handle, and a compiled copy in corrections[role] lets
+    the host plan corrected moves without asking the controller.
+    """
+
+    def __init__(self, profile_library=PROFILE_LIBRARY_FILE):
+        self.profile_library = profile_library
+        self._profiles = None
+        self.corrections = {}
+        self._axes = {}
+        self._opened = set()
+        self._lock = threading.Lock()
+        self._ready = Future()
+        self._listeners = []
+
+    def start(self):
+        """Starts binding the controllers in the background, returns immediately"""
+        def bind():
+            try:
+                self._ready.set_result(dict(zip(ROLES, initialize_axes())))
+            except Exception as e:
+                self._ready.set_exception(e)
+
+        threading.Thread(target=bind, name="axis-binding", daemon=True).start()
+
+    def wait_ready(self):
+        """Blocks until the controllers are bound, raises if a role has no controller"""
+        try:
+            axes = self._ready.result()
+        except Exception as e:
+            print("Binding the controllers failed: {}".format(e))
+            axes = {}
+        if any(axes.get(role) is None for role in ROLES):
+            # try again, the controllers may have been plugged in since
+            axes = dict(zip(ROLES, initialize_axes()))
+            self._ready = Future()
+            self._ready.set_result(axes)
+            missing = [role.upper() for role in ROLES if axes.get(role) is None]
+            if missing:
+                raise RuntimeError("No controller found for the {} axis".format(", ".join(missing)))
+        self._axes = axes
+        return axes
+
+    def get(self, role):
+        """Returns the opened axis for a role, opening it on first use"""
+        axis = self.wait_ready()[role]
+        with self._lock:
+            if role not in self._opened:
+                open_axes(axis)
+                self._opened.add(role)
+                self._check_profiles([role])
+                self._load_correction_tables([role])
+        return axis
+
+    def open_all(self):
+        """Opens every axis that is not open yet, in parallel"""
+        axes = self.wait_ready()
+        with self._lock:
+            closed = [axes[role] for role in ROLES if role not in self._opened]
+            if closed:
+                open_axes(*closed)
+                roles = [role for role in ROLES if role not in self._opened]
+                self._check_profiles(roles)
+                self._load_correction_tables(roles)
+                self._opened.update(ROLES)
+        return tuple(axes[role] for role in ROLES)
+
+    def _check_profiles(self, roles):
+        """Brings the controllers of roles to the profile the axis map names for them"""
+        bindings = axesInitializer.registry.bindings if axesInitializer.registry is not None else {}
+        roles = [role for role in roles if role in bindings and bindings[role].profile]
+        if not roles:
+            return
+        if self._profiles is None:
+            if not os.path.exists(self.profile_library):
+                print("No profile library {}, stage profiles are not checked".format(self.profile_library))
+                return
+            self._profiles = ProfileLibrary(self.profile_library)
+        # one worker per controller, the slowest axis sets the startup time
+        device_roles = {self._axes[role]._device_id: role for role in roles}
+        try:
+            _, reports = ensure_profiles(self._profiles,
+                                         {device_id: bindings[role].profile
+                                          for device_id, role in device_roles.items()})
+        except (KeyError, ValueError, ConnectionError, RuntimeError) as e:
+            print("Checking the stage profiles failed: {}".format(e))
+            return
+        for device_id, report in reports.items():
+            print("{} axis: {}".format(device_roles[device_id].upper(), report))
+
+    def _load_correction_tables(self, roles):
+        """Loads the correction tables the axis map names for roles into libximc and compiles them"""
+        bindings = axesInitializer.registry.bindings if axesInitializer.registry is not None else {}
+        for role in roles:
+            if role not in bindings or not bindings[role].correction_table:
+                continue
+            path = os.path.join(os.path.dirname(AXIS_MAP_FILE), bindings[role].correction_table)
+            try:
+                # compile first, so the host never holds a table libximc would have rejected
+                table = CorrectionTable.from_file(path)
+                set_device_table(self._axes[role]._device_id, path)
+            except (OSError, ValueError, RuntimeError) as e:
+                print("Loading the {} axis correction table failed: {}".format(role.upper(), e))
+                self.corrections.pop(role, None)
+                continue
+            self.corrections[role] = table
+
+    def on_reopen(self, listener):
+        """listener(role, axis) is called after an axis got a new device handle"""
+        self._listeners.append(listener)
+
+    def check(self, role):
+        """
+        Pings an opened axis with get_status and reopens it if the controller does not answer.
+        Returns True if the axis is usable afterwards.
+        """
+        if role not in self._opened:
+            return True
+        axis = self._axes[role]
+        try:
+            axis.get_status()
+            return True
+        except ConnectionError:
+            print("\n{} axis does not answer, reopening {}".format(role.upper(), axis.uri))
+        return self.reopen(role)
+
+    def check_all(self):
+        self.wait_ready()
+        return all([self.check(role) for role in ROLES])
+
+    def reopen(self, role):
+        axis = self._axes[role]
+        with self._lock:
+            forget(axis._device_id)
+            try:
+                axis.close_device()
+            except Exception:
+                # the old handle is dead anyway
+                axis._is_opened = False
+            self._opened.discard(role)
+            try:
+                open_axes(axis)
+            except Exception as e:
+                print("Reopening {} axis failed: {}".format(role.upper(), e))
+                return False
+            self._opened.add(role)
+            self._check_profiles([role])
+            self._load_correction_tables([role])
+        for listener in self._listeners:
+            listener(role, axis)
+        return True
+
+    def close_all(self):
+        with self._lock:
+            for role in list(self._opened):
+                forget(self._axes[role]._device_id)
+                self._axes[role].close_device()
+            self._opened.clear()
@@ -0,0 +1,276 @@
+import argparse
+import struct
+from array import array
+from fractions import Fraction
+
+from settings_cache import settings_cache
+from ximc_import import ll, _check_result
+
+# set_correction_table accepts 2 .. 99 rows
+MIN_ROWS, MAX_ROWS = 2, 99
+# interval lookup buckets per table interval
+BUCKETS_PER_INTERVAL = 4
+
+_F32 = struct.Struct("<f")
+_BITS = struct.Struct("<I")
+
+
+def f32(value):
+    """Rounds a float to the nearest float32, as a C float assignment does"""
+    return _F32.unpack(_F32.pack(value))[0]
+
+
+def parse_float32(text):
+    """
+    Rounds a decimal number straight to the nearest float32, like fscanf("%f").
+
+    float() rounds to a double first; rounding that again can be one float32 unit off
+    when the double lands exactly between two float32 values, so the nearest of the
+    neighbouring float32 values is picked against the exact decimal.
+    """
+    exact = Fraction(text)
+    bits = _BITS.unpack(_F32.pack(f32(float(exact))))[0]
+    best = None
+    for candidate in (bits - 1, bits, bits + 1):
+        if not 0 <= candidate <= 0xFFFFFFFF or candidate & 0x7F800000 == 0x7F800000:
+            continue
+        value = _F32.unpack(_BITS.pack(candidate))[0]
+        error = abs(Fraction(value) - exact)
+        # ties go to the even mantissa
+        if best is None or error < best[0] or (error == best[0] and not candidate & 1):
+            best = (error, value)
+    return best[1]
+
+
+def read_table(path):
+    """
+    Reads a libximc correction table file.
+
+    Same format and checks as set_correction_table: a header of two words, then rows
+    of coordinate and deviation separated by whitespace, 2 .. 99 rows, coordinates and
+    corrected coordinates (coordinate + deviation) strictly ascending in float32.
+
+    Returns:
+        (coordinates, deviations) as array("f")
+    """
+    with open(path) as f:
+        tokens = f.read().split()
+    if len(tokens) < 2:
+        raise ValueError("Correction table {} has no header".format(path))
+    numbers = tokens[2:]
+    if len(numbers) % 2:
+        raise ValueError("Correction table {} has an incomplete row".format(path))
+    try:
+        values = [parse_float32(number) for number in numbers]
+    except (ValueError, ZeroDivisionError, OverflowError) as e:
+        raise ValueError("Correction table {} is invalid: {}".format(path, e))
+    coordinates, deviations = array("f", values[0::2]), array("f", values[1::2])
+    if not MIN_ROWS <= len(coordinates) <= MAX_ROWS:
+        raise ValueError("Correction table {} has {} rows, {} .. {} are allowed"
+                         .format(path, len(coordinates), MIN_ROWS, MAX_ROWS))
+    for i in range(1, len(coordinates)):
+        if not f32(coordinates[i] - coordinates[i - 1]) > 0:
+            raise ValueError("Correction table {}: coordinates are not ascending at row {}".format(path, i + 1))
+        if not f32(f32(coordinates[i] + deviations[i]) - f32(coordinates[i - 1] + deviations[i - 1])) > 0:
+            raise ValueError("Correction table {}: corrected coordinates are not ascending at row {}"
+                             .format(path, i + 1))
+    return coordinates, deviations
+
+
+class CorrectionTable:
+    """
+    Host-side copy of a libximc correction table, compiled for batch lookups.
+
+    libximc corrects a user-unit position in float32: outside the table it adds the
+    deviation of the nearest end, inside it interpolates from the interval's right
+    end, (slope * (P - x[i+1]) + P) + d[i+1]. The table is compiled into one segment
+    per interval plus one per end, each a (knot, slope, offset) entry of dense float32
+    arrays; the ends are segments with slope 0, which reduce to P + d exactly. Every
+    operation is rounded to float32 in libximc's order, so correct() returns the value
+    command_move_calb sends and uncorrect() the one get_position_calb reports.
+
+    The interval is found through a bucket index over the coordinate range plus a step
+    to the neighbouring interval, instead of libximc's binary search; both pick the
+    same interval.
+
+    Args:
+        coordinates: table coordinates in user units, strictly ascending
+        deviations: mechanical error at each coordinate
+    """
+
+    def __init__(self, coordinates, deviations):
+        x = self.coordinates = array("f", coordinates)
+        d = self.deviations = array("f", deviations)
+        n = len(x)
+        if n != len(d) or not MIN_ROWS <= n <= MAX_ROWS:
+            raise ValueError("A correction table needs {} .. {} rows of coordinate and deviation"
+                             .format(MIN_ROWS, MAX_ROWS))
+        corrected = self.corrected = array("f", [f32(x[i] + d[i]) for i in range(n)])
+
+        # segment 0 is left of the table, 1 .. n-1 the intervals, n right of the table
+        self.knots = array("f", [x[0]] + [x[i] for i in range(1, n)] + [x[-1]])
+        self.slopes = array("f", [0.0] + [f32(f32(d[i] - d[i - 1]) / f32(x[i] - x[i - 1]))
+                                          for i in range(1, n)] + [0.0])
+        self.offsets = array("f", [d[0]] + [d[i] for i in range(1, n)] + [d[-1]])
+        # get_position_calb inverts from the corrected coordinates, but libximc finds
+        # the interval by comparing against the uncorrected ones
+        self.inverse_knots = array("f", [corrected[0]] + [corrected[i] for i in range(1, n)] + [corrected[-1]])
+        self.inverse_slopes = array("f", [0.0] + [f32(f32(d[i - 1] - d[i]) / f32(corrected[i] - corrected[i - 1]))
+                                                  for i in range(1, n)] + [0.0])
+        self.inverse_offsets = array("f", [-d[0]] + [-d[i] for i in range(1, n)] + [-d[-1]])
+
+        buckets = BUCKETS_PER_INTERVAL * (n - 1)
+        self._scale = buckets / (x[-1] - x[0])
+        first = []
+        i = 0
+        for bucket in range(buckets):
+            start = x[0] + bucket / self._scale
+            while i < n - 2 and x[i + 1] <= start:
+                i += 1
+            first.append(i)
+        self._first = array("H", first)
+
+    @classmethod
+    def from_file(cls, path):
+        return cls(*read_table(path))
+
+    def interval(self, position):
+        """Index i of the interval x[i] <= position < x[i+1], clamped to the table"""
+        x = self.coordinates
+        last = len(x) - 2
+        if position != position:
+            return 0
+        bucket = int(min(max((position - x[0]) * self._scale, 0), len(self._first) - 1))
+        i = self._first[bucket]
+        while i < last and position >= x[i + 1]:
+            i += 1
+        while i > 0 and position < x[i]:
+            i -= 1
+        return i
+
+    def _segment(self, position):
+        x = self.coordinates
+        if x[0] >= position:
+            return 0
+        if position >= x[-1]:
+            return len(x)
+        return self.interval(position) + 1
+
+    def _inverse_segment(self, position):
+        corrected = self.corrected
+        if corrected[0] >= position:
+            return 0
+        if position >= corrected[-1]:
+            return len(corrected)
+        return self.interval(position) + 1
+
+    @staticmethod
+    def _apply(positions, segments, knots, slopes, offsets):
+        # one float32 rounding per operation, in libximc's order
+        t = array("f", [p - knots[s] for p, s in zip(positions, segments)])
+        t = array("f", [slopes[s] * v for v, s in zip(t, segments)])
+        t = array("f", [v + p for v, p in zip(t, positions)])
+        return array("f", [v + offsets[s] for v, s in zip(t, segments)])
+
+    def correct_many(self, positions):
+        """Corrects a batch of user-unit positions for moves, returns array("f")"""
+        positions = array("f", positions)
+        segments = [self._segment(p) for p in positions]
+        return self._apply(positions, segments, self.knots, self.slopes, self.offsets)
+
+    def uncorrect_many(self, positions):
+        """Inverse of correct_many() as done by get_position_calb, returns array("f")"""
+        positions = array("f", positions)
+        segments = [self._inverse_segment(p) for p in positions]
+        return self._apply(positions, segments, self.inverse_knots, self.inverse_slopes, self.inverse_offsets)
+
+    def correct(self, position):
+        return self.correct_many((position,))[0]
+
+    def uncorrect(self, position):
+        return self.uncorrect_many((position,))[0]
+
+
+class Calibration:
+    """
+    User units <-> (Position, uPosition) exactly as the libximc *_calb functions convert them.
+
+    command_move_calb takes a float32 position, corrects it through the device's
+    correction table, divides by A in double precision and truncates into steps and
+    microsteps; get_position_calb goes back the same way. to_steps_many() gives the
+    command_move arguments of a whole target list without talking to the controller.
+
+    Args:
+        A (float): user units per step (calibration_t.A)
+        microstep_mode (int): MICROSTEP_MODE_FULL (1) .. MICROSTEP_MODE_FRAC_256 (9)
+        table (CorrectionTable): correction table loaded into the device, None for none
+    """
+
+    def __init__(self, A, microstep_mode, table=None):
+        if not 1 <= microstep_mode <= 9:
+            raise ValueError("Microstep mode {} is not supported by the _calb functions".format(microstep_mode))
+        self.A = float(A)
+        self.microstep_mode = microstep_mode
+        self.microsteps = 1 << (microstep_mode - 1)
+        self.table = table
+
+    @classmethod
+    def for_device(cls, device_id, A, table=None):
+        """Calibration with the microstep mode the controller's engine settings hold"""
+        return cls(A, settings_cache(device_id).get("engine_settings").MicrostepMode, table)
+
+    def calibration_t(self):
+        return ll.calibration_t(self.A, self.microstep_mode)
+
+    def to_steps_many(self, positions):
+        """User-unit positions -> [(Position, uPosition)] as command_move_calb would move"""
+        if self.table is not None:
+            positions = self.table.correct_many(positions)
+        else:
+            positions = array("f", positions)
+        A, microsteps = self.A, self.microsteps
+        steps = []
+        for p in positions:
+            s = p / A
+            whole = int(s)
+            steps.append((whole, int(microsteps * (s - whole))))
+        return steps
+
+    def to_user_many(self, steps):
+        """[(Position, uPosition)] -> user-unit positions as get_position_calb reports them"""
+        microsteps = f32(self.microsteps)
+        t = array("f", [u for _, u in steps])
+        t = array("f", [u / microsteps for u in t])
+        t = array("f", [u + p for u, p in zip(t, array("f", [p for p, _ in steps]))])
+        t = array("f", [v * self.A for v in t])
+        return self.table.uncorrect_many(t) if self.table is not None else t
+
+    def to_steps(self, position):
+        return self.to_steps_many((position,))[0]
+
+    def to_user(self, position, uposition=0):
+        return self.to_user_many(((position, uposition),))[0]
+
+
+def set_device_table(device_id, path):
+    """Loads a correction table file into libximc for device_id, None clears it"""
+    _check_result(ll.lib.set_correction_table(device_id, path.encode() if path else None))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Positions a correction table sends to the controller")
+    parser.add_argument("table", help="correction table file")
+    parser.add_argument("positions", type=float, nargs="+", help="positions in user units")
+    parser.add_argument("--steps-per-unit", type=float, default=8000, help="steps per user unit (1 / A)")
+    parser.add_argument("--microstep-mode", type=int, default=9, help="MicrostepMode, 9 = 1/256")
+    args = parser.parse_args()
+    table = CorrectionTable.from_file(args.table)
+    calibration = Calibration(1 / args.steps_per_unit, args.microstep_mode, table)
+    corrected = table.correct_many(args.positions)
+    print("{:>14} {:>14} {:>10} {:>10}".format("position", "corrected", "Position", "uPosition"))
+    for position, value, (steps, usteps) in zip(args.positions, corrected, calibration.to_steps_many(args.positions)):
+        print("{:>14.6f} {:>14.6f} {:>10} {:>10}".format(position, value, steps, usteps))
+
+
+if __name__ == "__main__":
+    main()
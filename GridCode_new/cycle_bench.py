@@ -0,0 +1,138 @@
+import argparse
+import json
+import math
+import tempfile
+import time
+
+import axesInitializer
+from axis_controller import AxisController
+from axis_registry import AXIS_MAP_FILE, AxisRegistry
+from batch_runner import resolve_targets
+from emu_bench import BENCH_TARGETS, StopWatcher, make_emulators
+from ximc_import import ll
+
+PERCENTILES = (50, 95, 99)
+
+
+def percentile(values, p):
+    """Nearest-rank percentile of a non-empty list"""
+    ordered = sorted(values)
+    return ordered[max(0, math.ceil(p / 100 * len(ordered)) - 1)]
+
+
+class CycleBench:
+    """
+    Times every phase of a disc placement cycle.
+
+    host_coordinates is the Python work of turning a target into Coordinates
+    (GridCodeClass.get_placement_coordinates and CoordinateClass). Each motion leg
+    (z_lift, xy_traverse, z_descend, or blended_move) is split into the time until the
+    StopWatcher saw all axes at rest and the wait overhead from there until the leg
+    returned (<leg>.wait). cycle is the whole placement including the host part.
+
+    Args:
+        control (AxisController): opened controller
+        watcher (StopWatcher): running stop watcher, None to skip the wait split
+    """
+
+    def __init__(self, control, watcher):
+        self.control = control
+        self.watcher = watcher
+        self.cycles = []
+        self._current = None
+        control.phase_hook = self._phase
+
+    def _phase(self, phase, start, end):
+        started_at = self.watcher.started_at if self.watcher is not None else None
+        stopped_at = self.watcher.stopped_at if self.watcher is not None else None
+        # the watcher must have seen this leg's motion start, not the end of the previous leg
+        if started_at is not None and stopped_at is not None and start <= started_at <= stopped_at <= end:
+            self._current[phase] = stopped_at - start
+            self._current[phase + ".wait"] = end - stopped_at
+        else:
+            self._current[phase] = end - start
+
+    def run_cycle(self, target):
+        self._current = {}
+        start = time.perf_counter()
+        coordinates = resolve_targets([target])[0]
+        self._current["host_coordinates"] = time.perf_counter() - start
+        self.control.place_disc(coordinates)
+        self._current["cycle"] = time.perf_counter() - start
+        self.cycles.append(self._current)
+
+    def run(self, targets, cycles):
+        for i in range(cycles):
+            self.run_cycle(targets[i % len(targets)])
+
+    def table(self):
+        """Returns {phase: {"n", "mean", "p50", "p95", "p99", "max"}} in seconds"""
+        phases = {}
+        for cycle in self.cycles:
+            for phase, seconds in cycle.items():
+                phases.setdefault(phase, []).append(seconds)
+        table = {}
+        for phase, values in phases.items():
+            stats = {"n": len(values), "mean": sum(values) / len(values), "max": max(values)}
+            for p in PERCENTILES:
+                stats["p{}".format(p)] = percentile(values, p)
+            table[phase] = stats
+        return table
+
+
+def print_table(table):
+    columns = ["mean"] + ["p{}".format(p) for p in PERCENTILES] + ["max"]
+    print("\n{:<20} {:>5}".format("phase", "n") + "".join(" {:>10}".format(c + " ms") for c in columns))
+    for phase, stats in table.items():
+        print("{:<20} {:>5}".format(phase, stats["n"]) +
+              "".join(" {:>10.3f}".format(stats[c] * 1000) for c in columns))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Per-phase cycle time of disc placements")
+    parser.add_argument("--hardware", action="store_true",
+                        help="use the controllers of the axis map instead of xi-emu controllers")
+    parser.add_argument("--dir", help="directory for the emulator state files (default: a temporary directory)")
+    parser.add_argument("--speed", type=int, default=100000, help="emulated speed / accel / decel in steps/s(^2)")
+    parser.add_argument("--cycles", type=int, default=20, help="number of placements")
+    parser.add_argument("--blended", action="store_true", help="overlap the Z and XY legs of placements")
+    parser.add_argument("--linear-xy", action="store_true", help="straight-line XY moves")
+    parser.add_argument("--no-watch", action="store_true",
+                        help="do not poll the axes for the wait split (no extra USB traffic)")
+    parser.add_argument("--json", help="write the cycles and the percentile table to this file")
+    args = parser.parse_args()
+
+    if args.hardware:
+        registry = AxisRegistry.from_file()
+        if registry is None or not registry.has_all_uris():
+            parser.error("--hardware needs an axis map with X, Y and Z URIs in {}, run the application once "
+                         "to create it".format(AXIS_MAP_FILE))
+        axesInitializer.use_registry(registry)
+    else:
+        directory = args.dir or tempfile.mkdtemp(prefix="gridcode-bench-")
+        axesInitializer.use_registry(make_emulators(directory, args.speed))
+
+    control = AxisController(blended_motion=args.blended, linear_xy=args.linear_xy)
+    control.open_all()
+    watcher = None if args.no_watch else StopWatcher(ll.lib, control.engine.device_ids)
+    if watcher is not None:
+        watcher.start()
+    bench = CycleBench(control, watcher)
+    try:
+        bench.run(BENCH_TARGETS, args.cycles)
+    finally:
+        if watcher is not None:
+            watcher.stop()
+        control.close_all()
+
+    table = bench.table()
+    print_table(table)
+    if args.json:
+        config = {"hardware": args.hardware, "speed": None if args.hardware else args.speed,
+                  "cycles": args.cycles, "blended": args.blended, "linear_xy": args.linear_xy}
+        with open(args.json, "w") as f:
+            json.dump({"config": config, "phases": table, "cycles": bench.cycles}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,81 @@
+import json
+import os
+import threading
+from concurrent.futures import Future
+
+from ximc_import import ll, ximc
+
+CACHE_FILE = os.path.join(os.path.abspath(os.path.dirname(__file__)), "device_cache.json")
+
+# enumerate_devices() keys kept in the cache
+CACHED_KEYS = ("uri", "device_serial", "ControllerName", "PositionerName")
+
+
+def load_cache(path=CACHE_FILE):
+    """Returns the cached device list, or an empty list if there is no usable cache"""
+    try:
+        with open(path) as f:
+            devices = json.load(f)
+    except (OSError, ValueError):
+        return []
+    return [d for d in devices if isinstance(d, dict) and "uri" in d]
+
+
+def save_cache(devices, path=CACHE_FILE):
+    entries = [{key: device.get(key) for key in CACHED_KEYS} for device in devices]
+    try:
+        with open(path, "w") as f:
+            json.dump(entries, f, indent=2)
+    except OSError as e:
+        print("Could not write device cache {}: {}".format(path, e))
+
+
+def enumerate_and_cache(enum_flags, enum_hints, path=CACHE_FILE):
+    """Full probe/network enumeration, the result replaces the cache"""
+    devices = ximc.enumerate_devices(enum_flags, enum_hints)
+    if devices:
+        save_cache(devices, path)
+    return devices
+
+
+def _enumerate_in_background(enum_flags, enum_hints, path):
+    future = Future()
+
+    def run():
+        try:
+            future.set_result(enumerate_and_cache(enum_flags, enum_hints, path))
+        except Exception as e:
+            future.set_exception(e)
+
+    threading.Thread(target=run, name="device-enumeration", daemon=True).start()
+    return future
+
+
+def probe(uri):
+    """True if a XIMC controller answers at uri"""
+    return ll.lib.probe_device(uri.encode()) == ll.Result.Ok
+
+
+def discover_devices(enum_flags, enum_hints, path=CACHE_FILE):
+    """
+    Finds the controllers without a full enumeration whenever possible.
+
+    The devices found last time (URI, serial, ControllerName, stage name) are read
+    from the cache and checked one by one with probe_device. If every cached device
+    answers, they are returned as is. Otherwise a full enumeration is started in the
+    background; it refreshes the cache when it finishes.
+
+    Returns:
+        (devices, refresh): devices is the list of cached devices that answered, in the
+        format of enumerate_devices(). refresh is None when the cache was complete, or a
+        concurrent.futures.Future resolving to the fresh enumeration.
+    """
+    cached = load_cache(path)
+    alive = [d for d in cached if probe(d["uri"])]
+    if cached and len(alive) == len(cached):
+        return alive, None
+
+    if cached:
+        print("{} of {} cached device(s) did not answer, enumerating devices".format(len(cached) - len(alive),
+                                                                                    len(cached)))
+    return alive, _enumerate_in_background(enum_flags, enum_hints, path)
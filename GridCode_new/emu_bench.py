@@ -0,0 +1,283 @@
+import argparse
+import json
+import os
+import tempfile
+import threading
+import time
+from ctypes import byref
+
+import axesInitializer
+from axis_controller import AxisController
+from axis_registry import ROLES, AxisBinding, AxisRegistry
+from batch_runner import resolve_targets
+from call_stats import install_lib
+from ximc_import import ll
+
+# Placement targets of the bench, in the format of batch_runner.load_targets()
+BENCH_TARGETS = [
+    {"x_markings": 1, "x_shape": "square", "y_markings": 1, "y_shape": "square", "delta_x": 0, "delta_y": 0},
+    {"x_markings": 3, "x_shape": "circle", "y_markings": 2, "y_shape": "square", "delta_x": 40, "delta_y": 40},
+    {"x_markings": 2, "x_shape": "square", "y_markings": 4, "y_shape": "circle", "delta_x": 0, "delta_y": 80},
+    {"x_markings": 5, "x_shape": "square", "y_markings": 1, "y_shape": "circle", "delta_x": 80, "delta_y": 0},
+    {"x_markings": 4, "x_shape": "circle", "y_markings": 3, "y_shape": "circle", "delta_x": 20, "delta_y": 20},
+]
+
+# Manual jog sequence: (key, press time, hold time) in seconds from the start of manual mode
+JOG_SEQUENCE = [
+    ("left", 0.1, 0.3),
+    ("up", 0.5, 0.3),
+    ("right", 0.9, 0.2),
+    ("down", 0.9, 0.2),
+    ("+", 1.3, 0.2),
+    ("-", 1.6, 0.2),
+]
+
+
+class CallCounter:
+    """
+    Stands in for the libximc library object and counts the calls of every function.
+    Each libximc call is one request/response transaction with the controller.
+    """
+
+    def __init__(self, lib):
+        self.lib = lib
+        self.counts = {}
+        self._lock = threading.Lock()
+
+    def __getattr__(self, name):
+        function = getattr(self.lib, name)
+        if not callable(function):
+            return function
+
+        def counted(*args):
+            with self._lock:
+                self.counts[name] = self.counts.get(name, 0) + 1
+            return function(*args)
+        return counted
+
+    def snapshot(self):
+        with self._lock:
+            return dict(self.counts)
+
+
+class StopWatcher:
+    """
+    Polls the status of every axis at a high rate through the uncounted library and
+    remembers when the last moving axis came to rest. The difference between that and
+    the moment an operation returns is its completion-detection lag.
+
+    Args:
+        lib: libximc library object (not the CallCounter)
+        device_ids (dict): axis name -> device_t handle
+        interval (float): polling interval in seconds
+    """
+
+    def __init__(self, lib, device_ids, interval=0.001):
+        self.lib = lib
+        self.device_ids = device_ids
+        self.interval = interval
+        # last transitions of the machine from rest to moving and back (perf_counter times)
+        self.started_at = None
+        self.stopped_at = None
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run, name="bench-stop-watcher", daemon=True)
+
+    def start(self):
+        self._thread.start()
+
+    def stop(self):
+        self._stop.set()
+        self._thread.join()
+
+    def _moving(self, status):
+        return bool(status.MvCmdSts & ll.MvcmdStatus.MVCMD_RUNNING or status.MoveSts & ll.MoveState.MOVE_STATE_MOVING)
+
+    def _run(self):
+        status = ll.status_t()
+        was_moving = False
+        while not self._stop.is_set():
+            moving = False
+            for device_id in list(self.device_ids.values()):
+                if self.lib.get_status(device_id, byref(status)) == ll.Result.Ok and self._moving(status):
+                    moving = True
+            if moving and not was_moving:
+                self.started_at = time.perf_counter()
+            elif was_moving and not moving:
+                self.stopped_at = time.perf_counter()
+            was_moving = moving
+            self._stop.wait(self.interval)
+
+
+class ScriptedJogInput:
+    """Stands in for the keyboard in manual mode: plays a jog sequence as key events, then presses ESC"""
+
+    def __init__(self, sequence, callback, settle=0.3):
+        events = [(press, name, True) for name, press, _ in sequence]
+        events += [(press + hold, name, False) for name, press, hold in sequence]
+        events.append((max(press + hold for _, press, hold in sequence) + settle, "esc", True))
+        self.events = sorted(events, key=lambda event: event[0])
+        self.callback = callback
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run, name="scripted-jog", daemon=True)
+        self._thread.start()
+
+    def _run(self):
+        start = time.perf_counter()
+        for at, name, pressed in self.events:
+            if self._stop.wait(max(0.0, start + at - time.perf_counter())):
+                return
+            self.callback(name, pressed)
+
+    def stop(self):
+        self._stop.set()
+        self._thread.join()
+
+
+def make_emulators(directory, speed):
+    """
+    Creates fresh xi-emu controllers for X, Y and Z in directory (old state files are
+    deleted so every run starts from the same state) with speed, acceleration and
+    deceleration set to speed.
+
+    Returns:
+        AxisRegistry binding the roles to the emulators
+    """
+    bindings = []
+    for role in ROLES:
+        path = os.path.join(os.path.abspath(directory), "emu_{}.bin".format(role))
+        if os.path.exists(path):
+            os.remove(path)
+        uri = "xi-emu:///" + path
+        device_id = ll.lib.open_device(uri.encode())
+        move_settings = ll.move_settings_t()
+        ll.lib.get_move_settings(device_id, byref(move_settings))
+        move_settings.Speed = move_settings.Accel = move_settings.Decel = speed
+        move_settings.uSpeed = 0
+        ll.lib.set_move_settings(device_id, byref(move_settings))
+        ll.lib.close_device(byref(ll.c_int(device_id)))
+        bindings.append(AxisBinding(role, uri=uri))
+    return AxisRegistry(bindings)
+
+
+class Bench:
+    """
+    Runs AxisController operations against xi-emu controllers and records per call the
+    wall-clock latency, the number of libximc calls by function and the completion-detection
+    lag (time from the machine coming to rest until the call returned).
+
+    Args:
+        control (AxisController): controller bound to emulated axes
+        counter (CallCounter): installed call counter
+        watcher (StopWatcher): running stop watcher
+    """
+
+    def __init__(self, control, counter, watcher):
+        self.control = control
+        self.counter = counter
+        self.watcher = watcher
+        self.samples = []
+
+    def measure(self, operation, function, *args, lag=True):
+        before = self.counter.snapshot()
+        start = time.perf_counter()
+        function(*args)
+        end = time.perf_counter()
+        after = self.counter.snapshot()
+
+        calls = {name: count - before.get(name, 0) for name, count in after.items() if count != before.get(name, 0)}
+        started_at, stopped_at = self.watcher.started_at, self.watcher.stopped_at
+        if not lag or started_at is None or stopped_at is None or not start <= started_at <= stopped_at <= end:
+            lag = None
+        else:
+            lag = end - stopped_at
+        self.samples.append({"operation": operation, "latency": end - start, "calls": sum(calls.values()),
+                             "calls_by_function": calls, "lag": lag})
+
+    def jog(self):
+        jog_input = self.control.jog_input
+        self.control.jog_input = lambda callback: ScriptedJogInput(JOG_SEQUENCE, callback)
+        try:
+            self.control.start_manual_control()
+        finally:
+            self.control.jog_input = jog_input
+
+    def run(self, coordinates, repeat):
+        for _ in range(repeat):
+            self.measure("home_xy", self.control.home_xy)
+            self.measure("home_z", self.control.home_z)
+            self.measure("disc_load_position", self.control.disc_load_position, coordinates[0])
+            for target in coordinates:
+                self.measure("place_disc", self.control.place_disc, target)
+            # manual mode returns on ESC, not when the axes stop
+            self.measure("manual_jog", self.jog, lag=False)
+
+    def summary(self):
+        """Returns {operation: statistics} over all samples"""
+        operations = {}
+        for sample in self.samples:
+            operations.setdefault(sample["operation"], []).append(sample)
+        summary = {}
+        for operation, samples in operations.items():
+            latencies = [s["latency"] for s in samples]
+            lags = [s["lag"] for s in samples if s["lag"] is not None]
+            summary[operation] = {
+                "count": len(samples),
+                "latency_mean": sum(latencies) / len(latencies),
+                "latency_min": min(latencies),
+                "latency_max": max(latencies),
+                "calls_mean": sum(s["calls"] for s in samples) / len(samples),
+                "lag_mean": sum(lags) / len(lags) if lags else None,
+                "lag_max": max(lags) if lags else None,
+            }
+        return summary
+
+
+def print_summary(summary):
+    def ms(value):
+        return "{:9.1f}".format(value * 1000) if value is not None else "        -"
+
+    print("\n{:<20} {:>5} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9}".format(
+        "operation", "n", "mean ms", "min ms", "max ms", "calls", "lag ms", "lag max"))
+    for operation, stats in summary.items():
+        print("{:<20} {:>5} {} {} {} {:9.1f} {} {}".format(
+            operation, stats["count"], ms(stats["latency_mean"]), ms(stats["latency_min"]),
+            ms(stats["latency_max"]), stats["calls_mean"], ms(stats["lag_mean"]), ms(stats["lag_max"])))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Runs the placement operations against xi-emu controllers")
+    parser.add_argument("--dir", help="directory for the emulator state files (default: a temporary directory)")
+    parser.add_argument("--repeat", type=int, default=1, help="number of rounds")
+    parser.add_argument("--speed", type=int, default=100000, help="emulated speed / accel / decel in steps/s(^2)")
+    parser.add_argument("--blended", action="store_true", help="overlap the Z and XY legs of placements")
+    parser.add_argument("--linear-xy", action="store_true", help="straight-line XY moves")
+    parser.add_argument("--json", help="write every sample and the summary to this file")
+    args = parser.parse_args()
+
+    directory = args.dir or tempfile.mkdtemp(prefix="gridcode-bench-")
+    axesInitializer.use_registry(make_emulators(directory, args.speed))
+    counter = CallCounter(ll.lib)
+    real_lib = counter.lib
+    install_lib(counter)
+
+    control = AxisController(blended_motion=args.blended, linear_xy=args.linear_xy)
+    control.open_all()
+    watcher = StopWatcher(real_lib, control.engine.device_ids)
+    watcher.start()
+    bench = Bench(control, counter, watcher)
+    try:
+        bench.run(resolve_targets(BENCH_TARGETS), args.repeat)
+    finally:
+        watcher.stop()
+        control.close_all()
+        install_lib(real_lib)
+
+    summary = bench.summary()
+    print_summary(summary)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"samples": bench.samples, "summary": summary}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
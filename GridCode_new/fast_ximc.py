@@ -0,0 +1,144 @@
+import os
+import sys
+import time
+from ctypes import CDLL, POINTER, byref, c_int
+
+from ximc_import import ll, ximc, _check_result
+
+# argument types of the functions FastAxis binds, after the device_t
+SIGNATURES = {
+    "get_status": [POINTER(ll.status_t)],
+    "get_position": [POINTER(ll.get_position_t)],
+    "command_move": [c_int, c_int],
+    "command_movr": [c_int, c_int],
+    "command_sstp": [],
+    "command_stop": [],
+}
+
+
+def _bind(name):
+    """
+    Returns a typed function pointer for a libximc function.
+
+    The pointer is a private copy with argtypes and restype set, so ctypes converts the
+    arguments without guessing and the shared ll.lib functions stay untouched. When
+    ll.lib has been replaced by a wrapper (call_stats, emu_bench) the wrapper's function
+    is used, so its calls are still seen there.
+    """
+    lib = ll.lib
+    if not isinstance(lib, CDLL):
+        return getattr(lib, name)
+    function = lib._FuncPtr((name, lib))
+    function.argtypes = [c_int] + SIGNATURES[name]
+    function.restype = c_int
+    return function
+
+
+class FastAxis:
+    """
+    Typed, allocation-free access to the hot libximc calls of one axis.
+
+    The highlevel Axis converts every call into new Python structures and the untyped
+    ll.lib functions infer their argument conversions on each call. FastAxis binds
+    typed function pointers once and reads into one status_t and one get_position_t
+    that are reused for every call: read_status() returns that buffer itself (a view,
+    overwritten by the next read) and status_view() exposes it as a memoryview.
+    ctypes releases the GIL for the duration of each foreign call.
+
+    Args:
+        device_ids (dict): axis name -> device_t handle (shared, a reopened axis is picked up)
+        name (str): axis name
+    """
+
+    def __init__(self, device_ids, name):
+        self.device_ids = device_ids
+        self.name = name
+        self.status = ll.status_t()
+        self.position = ll.get_position_t()
+        self._status_ref = byref(self.status)
+        self._position_ref = byref(self.position)
+        self._get_status = _bind("get_status")
+        self._get_position = _bind("get_position")
+        self._command_move = _bind("command_move")
+        self._command_movr = _bind("command_movr")
+        self._command_sstp = _bind("command_sstp")
+        self._command_stop = _bind("command_stop")
+
+    def read_status(self):
+        """Reads get_status into the reused status_t and returns it"""
+        result = self._get_status(self.device_ids[self.name], self._status_ref)
+        if result:
+            _check_result(result)
+        return self.status
+
+    def status_view(self):
+        """The raw bytes of the last status read, without a copy"""
+        return memoryview(self.status).cast("B")
+
+    def read_position(self):
+        """Returns (Position, uPosition)"""
+        result = self._get_position(self.device_ids[self.name], self._position_ref)
+        if result:
+            _check_result(result)
+        return self.position.Position, self.position.uPosition
+
+    def move(self, position, uposition=0):
+        result = self._command_move(self.device_ids[self.name], position, uposition)
+        if result:
+            _check_result(result)
+
+    def movr(self, shift, ushift=0):
+        result = self._command_movr(self.device_ids[self.name], shift, ushift)
+        if result:
+            _check_result(result)
+
+    def sstp(self):
+        result = self._command_sstp(self.device_ids[self.name])
+        if result:
+            _check_result(result)
+
+    def stop(self):
+        result = self._command_stop(self.device_ids[self.name])
+        if result:
+            _check_result(result)
+
+
+def benchmark(uri, calls=20000):
+    """
+    Host-side cost of one get_status round trip through the highlevel Axis, the untyped
+    lowlevel function and FastAxis. Run against xi-emu to leave only the Python overhead.
+
+    Returns:
+        {path: microseconds per call}
+    """
+    axis = ximc.Axis(uri)
+    axis.open_device()
+    try:
+        device_id = axis._device_id
+        status = ll.status_t()
+        fast = FastAxis({"axis": device_id}, "axis")
+
+        def lowlevel():
+            _check_result(ll.lib.get_status(device_id, byref(status)))
+
+        paths = {"highlevel Axis.get_status": axis.get_status,
+                 "lowlevel ll.lib.get_status": lowlevel,
+                 "FastAxis.read_status": fast.read_status}
+        results = {}
+        for path, function in paths.items():
+            for _ in range(calls // 10):
+                function()
+            start = time.perf_counter()
+            for _ in range(calls):
+                function()
+            results[path] = (time.perf_counter() - start) / calls * 1e6
+        return results
+    finally:
+        axis.close_device()
+
+
+if __name__ == "__main__":
+    uri = sys.argv[1] if len(sys.argv) > 1 else "xi-emu:///" + os.path.join(os.path.abspath(os.sep), "tmp",
+                                                                             "fast_ximc_bench.bin")
+    for path, us in benchmark(uri).items():
+        print("{:<28} {:8.2f} us/call".format(path, us))
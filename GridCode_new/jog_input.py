@@ -0,0 +1,164 @@
+import os
+import select
+import struct
+import sys
+import threading
+
+import keyboard
+
+# struct input_event from linux/input.h: struct timeval, __u16 type, __u16 code, __s32 value
+INPUT_EVENT = struct.Struct("llHHi")
+EV_KEY, EV_REP = 0x01, 0x14
+# input_event.value of EV_KEY events
+KEY_RELEASE, KEY_PRESS, KEY_REPEAT = 0, 1, 2
+
+# linux/input-event-codes.h -> the key names manual control uses
+EVDEV_KEYS = {
+    1: "esc",      # KEY_ESC
+    12: "-",       # KEY_MINUS
+    13: "+",       # KEY_EQUAL, "+" is Shift+"=" on the main block
+    25: "p",       # KEY_P
+    74: "-",       # KEY_KPMINUS
+    78: "+",       # KEY_KPPLUS
+    103: "up",     # KEY_UP
+    105: "left",   # KEY_LEFT
+    106: "right",  # KEY_RIGHT
+    108: "down",   # KEY_DOWN
+}
+# names reported by the keyboard module -> the same key names
+HOOK_KEYS = {"esc": "esc", "-": "-", "+": "+", "=": "+", "p": "p",
+             "up": "up", "down": "down", "left": "left", "right": "right"}
+
+INPUT_DEVICES_FILE = "/proc/bus/input/devices"
+
+
+def find_keyboards(devices_file=INPUT_DEVICES_FILE):
+    """
+    Event device paths of the keyboards listed in /proc/bus/input/devices: entries with
+    a kbd handler that report key events with autorepeat.
+    """
+    with open(devices_file) as f:
+        entries = f.read().split("\n\n")
+    paths = []
+    for entry in entries:
+        handlers, events = [], 0
+        for line in entry.splitlines():
+            if line.startswith("H: Handlers="):
+                handlers = line.split("=", 1)[1].split()
+            elif line.startswith("B: EV="):
+                events = int(line.split("=", 1)[1], 16)
+        if "kbd" not in handlers or not events & (1 << EV_KEY) or not events & (1 << EV_REP):
+            continue
+        paths += [os.path.join("/dev/input", handler) for handler in handlers if handler.startswith("event")]
+    return paths
+
+
+class EvdevKeyboard:
+    """
+    Reads key events straight from Linux event devices (/dev/input/event*) on a
+    dedicated thread.
+
+    The thread sleeps in select() until the kernel has an event and calls
+    callback(key, pressed) right away, so a key release reaches the caller without any
+    polling interval. Autorepeat is dropped: one call per press and one per release.
+    Only keys manual control uses (EVDEV_KEYS) are reported. Reading the devices needs
+    root or membership in the input group.
+
+    Args:
+        callback: callback(key name, pressed), runs on the input thread
+        paths (list): event devices to read, None for every keyboard
+    """
+
+    def __init__(self, callback, paths=None):
+        self.callback = callback
+        self.paths = paths if paths is not None else find_keyboards()
+        self._fds = []
+        for path in self.paths:
+            try:
+                self._fds.append(os.open(path, os.O_RDONLY | os.O_NONBLOCK))
+            except OSError:
+                pass
+        if not self._fds:
+            raise PermissionError("No readable keyboard among {}".format(self.paths or "the input devices"))
+        # writing to the pipe wakes the thread up for stop()
+        self._wake_read, self._wake_write = os.pipe()
+        self._thread = threading.Thread(target=self._run, name="jog-input", daemon=True)
+
+    def start(self):
+        self._thread.start()
+        return self
+
+    def stop(self):
+        os.write(self._wake_write, b"\0")
+        self._thread.join()
+        for fd in self._fds + [self._wake_read, self._wake_write]:
+            os.close(fd)
+
+    def _run(self):
+        pending = {fd: b"" for fd in self._fds}
+        while pending:
+            ready, _, _ = select.select(list(pending) + [self._wake_read], [], [])
+            if self._wake_read in ready:
+                return
+            for fd in ready:
+                try:
+                    data = pending[fd] + os.read(fd, INPUT_EVENT.size * 64)
+                except BlockingIOError:
+                    continue
+                except OSError:
+                    # keyboard unplugged
+                    del pending[fd]
+                    continue
+                end = len(data) - len(data) % INPUT_EVENT.size
+                pending[fd] = data[end:]
+                for _, _, event_type, code, value in INPUT_EVENT.iter_unpack(data[:end]):
+                    if event_type == EV_KEY and value != KEY_REPEAT and code in EVDEV_KEYS:
+                        self.callback(EVDEV_KEYS[code], value == KEY_PRESS)
+
+
+class KeyboardHook:
+    """
+    Same events as EvdevKeyboard through the keyboard module's hook, for Windows and for
+    Linux without access to the event devices. Also event-driven, no polling.
+
+    Args:
+        callback: callback(key name, pressed), runs on the keyboard module's thread
+    """
+
+    def __init__(self, callback):
+        self.callback = callback
+        self._pressed = set()
+        self._hook = None
+
+    def start(self):
+        self._hook = keyboard.hook(self._on_event)
+        return self
+
+    def stop(self):
+        if self._hook is not None:
+            keyboard.unhook(self._hook)
+            self._hook = None
+
+    def _on_event(self, event):
+        key = HOOK_KEYS.get(event.name)
+        if key is None:
+            return
+        pressed = event.event_type == keyboard.KEY_DOWN
+        # the keyboard module repeats key down events while a key is held
+        if pressed == (event.name in self._pressed):
+            return
+        if pressed:
+            self._pressed.add(event.name)
+        else:
+            self._pressed.discard(event.name)
+        self.callback(key, pressed)
+
+
+def open_jog_input(callback):
+    """Starts the fastest available key event source: evdev on Linux, else the keyboard hook"""
+    if sys.platform.startswith("linux"):
+        try:
+            return EvdevKeyboard(callback).start()
+        except (OSError, ValueError) as e:
+            print("Reading the keyboard through evdev failed ({}), using the keyboard hook".format(e))
+    return KeyboardHook(callback).start()
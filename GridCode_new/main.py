@@ -2,18 +2,40 @@ from GridCodeClass import GridSelector
 from CoordinateClass import Coordinates
 from axis_controller import AxisController
 from mode_selector import ModeSelector
+from batch_runner import BatchRunner, load_targets, resolve_targets
+from path_optimizer import optimize_order
 import tkinter as tk
 import tkinter.messagebox as msgbox
+import tkinter.filedialog as filedialog
+import os
+import sys
+import axesInitializer
+import call_stats
+from axis_registry import ROLES, AxisBinding, AxisRegistry
+from ximc_logging import AsyncLogSink, LOGLEVEL_DEBUG
 
 
 def main():
 
+    if os.environ.get("GRIDCODE_CALL_STATS"):
+        # per-call libximc statistics, watch them with: python call_stats.py top
+        call_stats.install()
+    log_sink = None
+    if os.environ.get("GRIDCODE_XIMC_LOG"):
+        # libximc messages go to this file from a background thread, debug messages sampled 1 in 10
+        log_sink = AsyncLogSink(os.environ["GRIDCODE_XIMC_LOG"], sample={LOGLEVEL_DEBUG: 10})
+        log_sink.start()
+    # status, chart data and measurements of all axes go to this log once the axes are open,
+    # read it with telemetry.read_log
+    telemetry_path = os.environ.get("GRIDCODE_TELEMETRY")
+
     main_root = tk.Tk()  # Create a main root for all others
     main_root.withdraw()  # Hide the main root window
 
     # Step 1: Initialize motors
-    # AxisController initializes the axes and offers functions to operate them
-    control = AxisController()
+    # AxisController initializes the axes and offers functions to operate them.
+    # The controllers are connected in the background while the menu is shown.
+    control = AxisController(telemetry_path=telemetry_path)
     control.open_all()
 
     while True:
@@ -24,54 +46,95 @@ def main():
         """"clean up to allow proper loop"""
         del mode_selector
 
-        if mode == "placement coordinates":
-            # Get coordinates from user
-            grid = GridSelector(parent=main_root)
-            grid.run()
-            if grid.was_closed:
-                del grid
-                continue
-            x, y = grid.get_final_coordinates_mm()
-            coordinates = Coordinates(x, y)
-
-            """"clean up to allow proper loop"""
-            del grid
-
-            # # control the stage to place disc in desired coordinates
-            control.place_disc(coordinates)
-            control.print_all_positions()
-
-        elif mode == "manual control":
-            # ***************************** #
-            # *******MANUAL CONTROL******** #
-
-            control.start_manual_control()
-
-            # ***************************** #
-
-        elif mode == "loading position":
-
-            # Move to loading area coordinates
-            dummy = Coordinates(0, 0)
-            control.disc_load_position(dummy)
-
-        elif mode == "XY home":
-            control.home_xy()
-
-        elif mode == "Z home":
-            control.home_z()
-
-        elif mode == "zero XY":
-            control.set_zero_x()
-            control.set_zero_y()
-            control.print_all_positions()
+        if mode is None or mode == "exit":
+            break
 
-        elif mode == "zero Z":
-            control.set_zero_z()
-            control.print_all_positions()
+        try:
+            # reopen any controller that dropped off the USB bus since the last operation
+            control.check_connections()
+        except (ConnectionError, RuntimeError) as e:
+            msgbox.showerror("Hardware Error", f"Controllers are not available:\n{e}")
+            continue
+
+        try:
+            if mode == "placement coordinates":
+                # Get coordinates from user
+                grid = GridSelector(parent=main_root)
+                grid.run()
+                if grid.was_closed:
+                    del grid
+                    continue
+                x, y = grid.get_final_coordinates_mm()
+                coordinates = Coordinates(x, y)
+
+                """"clean up to allow proper loop"""
+                del grid
 
-        elif mode is None or mode == "exit":
-            break
+                # # control the stage to place disc in desired coordinates
+                control.place_disc(coordinates)
+                control.print_all_positions()
+
+            elif mode == "batch placement":
+                path = filedialog.askopenfilename(parent=main_root, title="Select placement list",
+                                                  filetypes=[("Placement lists", "*.csv *.json"),
+                                                             ("All files", "*.*")])
+                if not path:
+                    continue
+                try:
+                    coordinates_list = resolve_targets(load_targets(path))
+                except (OSError, ValueError) as e:
+                    msgbox.showerror("Batch Error", f"Could not load {path}:\n{e}")
+                    continue
+
+                # visit the targets in the order with the shortest total XY travel time
+                # the estimators must hold the full speed settings, not those of the last linear move
+                control.engine.restore_move_settings()
+                status = control.engine.read_status(("x", "y"))
+                start = (status["x"].CurPosition, status["y"].CurPosition)
+                coordinates_list = optimize_order(coordinates_list, start,
+                                                  control.engine.estimators["x"], control.engine.estimators["y"])
+
+                # all placements run back to back on the worker, no GUI in between
+                runner = BatchRunner(control, coordinates_list)
+                runner.start()
+                runner.join()
+                control.print_all_positions()
+                if runner.error is not None:
+                    msgbox.showerror("Batch Error", f"Batch aborted after {runner.placed} placements:\n{runner.error}")
+
+            elif mode == "manual control":
+                # ***************************** #
+                # *******MANUAL CONTROL******** #
+
+                control.start_manual_control()
+
+                # ***************************** #
+
+            elif mode == "loading position":
+
+                # Move to loading area coordinates
+                dummy = Coordinates(0, 0)
+                control.disc_load_position(dummy)
+
+            elif mode == "XY home":
+                control.home_xy()
+
+            elif mode == "Z home":
+                control.home_z()
+
+            elif mode == "zero XY":
+                control.set_zero_x()
+                control.set_zero_y()
+                control.print_all_positions()
+
+            elif mode == "zero Z":
+                control.set_zero_z()
+                control.print_all_positions()
+
+        except (ConnectionError, RuntimeError) as e:
+            # a controller dropped out, it is reopened before the next operation
+            msgbox.showerror("Hardware Error", f"Mode '{mode}' failed:\n{e}")
+            continue
 
         # Step 3: Ask whether to repeat or exit
         result = msgbox.askquestion(
@@ -85,8 +148,15 @@ def main():
 
     # Final Step: close all axes
     control.close_all()
+    if log_sink is not None:
+        log_sink.stop()
     print("Program Exited.")
 
 
 if __name__ == "__main__":
+    if len(sys.argv) > 1:
+        # URIs of the X (, Y, Z) controllers on the command line bind the roles for this run only,
+        # the axis map is left untouched
+        axesInitializer.use_registry(AxisRegistry([AxisBinding(role, uri=uri)
+                                                   for role, uri in zip(ROLES, sys.argv[1:])]))
     main()
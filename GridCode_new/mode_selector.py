@@ -16,6 +16,9 @@ class ModeSelector:
         tk.Button(self.root, text="Input Placement Coordinates", width=25, height=2,
                   command=lambda: self.select("placement coordinates")).pack(pady=5)
 
+        tk.Button(self.root, text="Batch Placement From File", width=25, height=2,
+                  command=lambda: self.select("batch placement")).pack(pady=5)
+
         tk.Button(self.root, text="Go to Loading Station", width=25, height=2,
                   command=lambda: self.select("loading position")).pack(pady=5)
 
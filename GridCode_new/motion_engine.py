@@ -0,0 +1,355 @@
+import threading
+from concurrent.futures import Future
+
+from command_queue import AxisQueue
+from completion_monitor import CompletionMonitor
+from fast_ximc import FastAxis
+from settings_cache import settings_cache
+from trajectory_estimator import TrajectoryEstimator
+from unit_conversion import Target, split_microsteps
+from ximc_import import ll, _check_result
+
+
+def _gather(futures):
+    """
+    Combines {axis name: future} into one future resolving to {axis name: result}.
+    Cancelling it cancels the futures of every axis.
+    """
+    combined = Future()
+    results = {}
+    lock = threading.Lock()
+
+    if not futures:
+        combined.set_result(results)
+        return combined
+
+    def on_combined_done(future):
+        if future.cancelled():
+            for axis_future in futures.values():
+                axis_future.cancel()
+
+    def on_done(name, future):
+        if future.cancelled():
+            combined.cancel()
+            return
+        error = future.exception()
+        with lock:
+            if combined.done():
+                return
+            if error is not None:
+                combined.set_exception(error)
+                return
+            results[name] = future.result()
+            if len(results) == len(futures):
+                combined.set_result(results)
+
+    for name, future in futures.items():
+        future.add_done_callback(lambda f, n=name: on_done(n, f))
+    combined.add_done_callback(on_combined_done)
+    return combined
+
+
+class MotionEngine:
+    """
+    Drives the X, Y and Z axes through direct libximc calls.
+
+    The highlevel Axis wrapper type-checks and converts every argument and blocks in
+    command_wait_for_stop on one axis at a time. The engine takes the already opened
+    axes, keeps their device_t handles and hands the commands of a move to one AxisQueue
+    per axis, so all controllers receive them in parallel. Completion of every axis
+    involved in the move is detected by a CompletionMonitor and reported through one
+    future. Absolute moves are timed in advance with a TrajectoryEstimator per axis so
+    the monitor only polls densely near the end.
+
+    Args:
+        x_axis, y_axis, z_axis (ximc.Axis): opened axes
+    """
+
+    def __init__(self, x_axis, y_axis, z_axis):
+        self.device_ids = {
+            "x": x_axis._device_id,
+            "y": y_axis._device_id,
+            "z": z_axis._device_id,
+        }
+        self.estimators = {name: TrajectoryEstimator(device_id) for name, device_id in self.device_ids.items()}
+        self.monitor = CompletionMonitor(self.device_ids)
+        # one I/O thread per axis, so the commands of a move go out to all controllers at once
+        self.queues = {name: AxisQueue(self.device_ids, name) for name in self.device_ids}
+        self._fast_axes = {name: FastAxis(self.device_ids, name) for name in self.device_ids}
+        # position of each axis when its last absolute move was started
+        self.start_positions = {}
+        # Y's sync_in_settings_t from before enable_sync_start(), None while sync start is off
+        self._sync_in_saved = None
+        # move_xy() rescales the X and Y move settings so both axes arrive together
+        self.linear_xy = False
+        # move_settings_t as found at start-up
+        self.nominal_move_settings = {name: settings_cache(device_id).get("move_settings")
+                                      for name, device_id in self.device_ids.items()}
+
+    def move_xyz(self, x=None, y=None, z=None):
+        """
+        Starts an absolute move on every axis whose target is given, in steps or as a
+        (Position, uPosition) pair. Axes left as None are not touched.
+
+        Returns:
+            concurrent.futures.Future resolving to {axis name: final position} once all
+            started axes have stopped.
+        """
+        targets = {"x": x, "y": y, "z": z}
+        self._restore_move_settings(name for name, target in targets.items() if target is not None)
+        return self._start_moves(targets)
+
+    def _start_moves(self, targets):
+        """move_xyz() with whatever move settings the controllers currently have"""
+        targets = {name: self._target(name, target) for name, target in targets.items() if target is not None}
+        started = {name: self.queues[name].submit(self._start_move, name, target) for name, target in targets.items()}
+        futures = {}
+        for name, target in targets.items():
+            self.start_positions[name] = started[name].result()
+            steps = self._steps(name, target)
+            duration = self.estimators[name].duration(self.start_positions[name], steps)
+            futures[name] = self.monitor.watch(name, steps, duration)
+        return _gather(futures)
+
+    def _start_move(self, device_id, name, target):
+        """Runs on the axis' queue: reads the start position, then starts the move"""
+        start = self._read_position(name)
+        self._fast_axes[name].move(*target)
+        return start
+
+    def _target(self, name, target):
+        """(Position, uPosition) of a target given in steps, as such a pair or as a Target"""
+        microsteps = self.estimators[name].microsteps
+        if isinstance(target, Target):
+            return target.in_microsteps(microsteps)
+        if isinstance(target, tuple):
+            position, uposition = int(target[0]), int(target[1])
+            if abs(uposition) >= microsteps:
+                raise ValueError("uPosition {} of the {} target does not fit the controller's {} microsteps per step"
+                                 .format(uposition, name.upper(), microsteps))
+            return position, uposition
+        return split_microsteps(round(target * microsteps), microsteps)
+
+    def _steps(self, name, target):
+        """A (Position, uPosition) target in steps"""
+        return target[0] + target[1] / self.estimators[name].microsteps
+
+    def enable_sync_start(self):
+        """
+        Lets X start Y in hardware: X's sync output pulses when a move starts (SYNCOUT_ONSTART).
+        Needs X's SYNC OUT wired to Y's SYNC IN. Y's own sync input is only armed for the
+        duration of a move_xy() call.
+        """
+        x_settings = settings_cache(self.device_ids["x"])
+        sync_out = x_settings.get("sync_out_settings")
+        sync_out.SyncOutFlags |= ll.SyncOutFlags.SYNCOUT_ENABLED | ll.SyncOutFlags.SYNCOUT_ONSTART
+        _check_result(x_settings.set("sync_out_settings", sync_out))
+
+        self._sync_in_saved = settings_cache(self.device_ids["y"]).get("sync_in_settings")
+
+    def move_xy(self, x, y):
+        """
+        Absolute XY move. With linear_xy set the move settings of X and Y are scaled so the
+        tool travels on a straight line and both axes arrive at the same time. With sync
+        start enabled Y's target is preloaded into its sync input and a single command_move
+        on X starts both axes on the same pulse.
+        """
+        x, y = self._target("x", x), self._target("y", y)
+        x_steps, y_steps = self._steps("x", x), self._steps("y", y)
+        x_start = self._read_position("x")
+        y_start = self._read_position("y")
+        if self.linear_xy:
+            scaled = self._linear_move_settings({"x": x_steps - x_start, "y": y_steps - y_start})
+            for name, settings in scaled.items():
+                self._apply_move_settings(name, settings)
+        else:
+            self._restore_move_settings(("x", "y"))
+
+        if self._sync_in_saved is None or x_steps == x_start or y_steps == y_start:
+            # no sync start, X would not move (no start pulse) or Y has nowhere to go
+            return self._start_moves({"x": x, "y": y})
+
+        sync_in = ll.sync_in_settings_t.from_buffer_copy(self._sync_in_saved)
+        sync_in.SyncInFlags |= ll.SyncInFlags.SYNCIN_ENABLED | ll.SyncInFlags.SYNCIN_GOTOPOSITION
+        sync_in.Position, sync_in.uPosition = y
+        y_settings = settings_cache(self.device_ids["y"]).get("move_settings")
+        sync_in.Speed = y_settings.Speed
+        sync_in.uSpeed = y_settings.uSpeed
+        _check_result(settings_cache(self.device_ids["y"]).set("sync_in_settings", sync_in))
+
+        self.start_positions["y"] = y_start
+        y_duration = self.estimators["y"].duration(y_start, y_steps)
+        futures = {"x": self._start_moves({"x": x})}
+        futures["y"] = self.monitor.watch("y", y_steps, y_duration)
+
+        # disarm Y's sync input before reporting completion, so later X moves do not drag Y along
+        done = Future()
+
+        def disarm(combined):
+            try:
+                _check_result(settings_cache(self.device_ids["y"]).set("sync_in_settings", self._sync_in_saved))
+                positions = combined.result()
+                positions.update(positions.pop("x"))
+                if positions["y"] != y[0]:
+                    raise RuntimeError("Y stopped at {} instead of {}, check the X SYNC OUT -> Y SYNC IN wiring"
+                                       .format(positions["y"], y[0]))
+                done.set_result(positions)
+            except Exception as e:
+                done.set_exception(e)
+
+        _gather(futures).add_done_callback(disarm)
+        return done
+
+    def movr_xyz(self, dx=None, dy=None, dz=None):
+        """Relative counterpart of move_xyz (shifts in steps)."""
+        shifts = {"x": dx, "y": dy, "z": dz}
+        self._restore_move_settings(name for name, shift in shifts.items() if shift is not None)
+        started = {name: self.queues[name].movr(shift) for name, shift in shifts.items() if shift is not None}
+        futures = {}
+        for name, command in started.items():
+            command.result()
+            futures[name] = self.monitor.watch(name)
+        return _gather(futures)
+
+    def home_xyz(self, x=False, y=False, z=False):
+        """Starts homing on the selected axes, returns a single completion future."""
+        selected = {"x": x, "y": y, "z": z}
+        started = {name: self.queues[name].home() for name, home in selected.items() if home}
+        futures = {}
+        for name, command in started.items():
+            command.result()
+            futures[name] = self.monitor.watch(name)
+        return _gather(futures)
+
+    def read_status(self, names=None):
+        """{axis name: status_t} of the given axes (all when None), read between their queued commands"""
+        futures = {name: self.queues[name].read_status() for name in (self.device_ids if names is None else names)}
+        return {name: future.result() for name, future in futures.items()}
+
+    def stop_all(self):
+        """Soft-stops every axis; the stops cancel any command still queued"""
+        for command in [axis_queue.sstp() for axis_queue in self.queues.values()]:
+            command.result()
+
+    def move_blended(self, x, y, z_top, z_bottom, z_clearance, xy_keep_out):
+        """
+        Z-up -> XY -> Z-down with overlapping legs.
+
+        XY starts as soon as Z has passed z_clearance on its way to z_top, and Z starts
+        descending to z_bottom once both X and Y are within xy_keep_out steps of their
+        targets (i.e. while they decelerate). Blocks until all axes have stopped.
+
+        Args:
+            x, y: XY target in steps or as (Position, uPosition) pairs
+            z_top (int): Z travel height in steps
+            z_bottom (int): Z target in steps
+            z_clearance (int): Z position beyond which XY may move (between z_bottom and z_top)
+            xy_keep_out (int): distance in steps from the XY target inside which Z may descend
+
+        Returns:
+            dict {axis name: final position}
+        """
+        up = 1 if z_top > z_bottom else -1
+
+        z_up = self.move_xyz(z=z_top)
+        if (self.start_positions["z"] - z_clearance) * up < 0:
+            z_now = self.monitor.watch_position("z", z_clearance, up).result()
+            if (z_now - z_clearance) * up < 0:
+                raise RuntimeError("Z stopped at {} before reaching the safe clearance height {}"
+                                   .format(z_now, z_clearance))
+
+        xy = self.move_xy(x, y)
+        for name, target in (("x", x), ("y", y)):
+            target = self._steps(name, self._target(name, target))
+            distance = target - self.start_positions[name]
+            if abs(distance) > xy_keep_out:
+                direction = 1 if distance > 0 else -1
+                threshold = target - direction * xy_keep_out
+                # also resolves when the axis stops short, e.g. on a stop or a limit switch
+                now = self.monitor.watch_position(name, threshold, direction).result()
+                if (now - threshold) * direction < 0:
+                    raise RuntimeError("{} stopped at {} before entering the keep-out zone at {}, Z stays up"
+                                       .format(name.upper(), now, threshold))
+
+        if z_up.done():
+            # Z-up is over already, do not descend after a failed status read
+            z_up.result()
+        # a new move command retargets the controller, so the descent takes over
+        # whatever is left of the Z-up move and its watch would only end with the descent
+        z_down = self.move_xyz(z=z_bottom)
+        if not z_up.cancel():
+            z_up.result()
+        positions = xy.result()
+        positions.update(z_down.result())
+        return positions
+
+    def rebind(self, name, axis):
+        """Switches an axis to the new device handle after it was reopened"""
+        self.device_ids[name] = axis._device_id
+        self.estimators[name].device_id = axis._device_id
+        # the controller may have been power cycled and lost the scaled settings
+        self.estimators[name].refresh()
+        if self._sync_in_saved is not None and name in ("x", "y"):
+            # X's sync output or Y's saved sync input belong to the old handle, set them up again
+            self.enable_sync_start()
+
+    def _apply_move_settings(self, name, settings):
+        """set_move_settings, skipped by the settings cache when the controller already has these settings"""
+        _check_result(settings_cache(self.device_ids[name]).set("move_settings", settings))
+        self.estimators[name].update(settings)
+
+    def _restore_move_settings(self, names):
+        """Puts the start-up move settings back on axes a linear XY move has rescaled"""
+        for name in names:
+            self._apply_move_settings(name, self.nominal_move_settings[name])
+
+    def restore_move_settings(self):
+        """Restores the start-up move settings of every axis, e.g. before jogging with the highlevel Axis"""
+        self._restore_move_settings(self.device_ids)
+
+    def _linear_move_settings(self, distances):
+        """
+        Move settings for a straight-line move over {axis name: distance in steps}.
+
+        Speed, Accel and Decel of every axis are the same base profile multiplied by the
+        axis' share of the longest distance, so all positions stay proportional during the
+        ramps as well as at cruise speed. The base profile is the fastest one no axis
+        exceeds its own start-up settings with. Axes that do not move keep their settings.
+        """
+        longest = max(abs(distance) for distance in distances.values())
+        scaled = {name: self.nominal_move_settings[name] for name in distances}
+        if longest == 0:
+            return scaled
+        shares = {name: abs(distance) / longest for name, distance in distances.items() if distance}
+
+        def nominal(name):
+            settings = self.nominal_move_settings[name]
+            return settings.Speed + settings.uSpeed / self.estimators[name].microsteps, settings.Accel, settings.Decel
+
+        speed = min(nominal(name)[0] / share for name, share in shares.items())
+        accel = min(nominal(name)[1] / share for name, share in shares.items())
+        decel = min(nominal(name)[2] / share for name, share in shares.items())
+        for name, share in shares.items():
+            microsteps = self.estimators[name].microsteps
+            settings = ll.move_settings_t.from_buffer_copy(self.nominal_move_settings[name])
+            usteps = min(round(speed * share * microsteps), round(nominal(name)[0] * microsteps))
+            settings.Speed, settings.uSpeed = divmod(max(usteps, 1), microsteps)
+            settings.Accel = max(1, round(accel * share))
+            settings.Decel = max(1, round(decel * share))
+            scaled[name] = settings
+        return scaled
+
+    def _read_position(self, name):
+        """Current position of an axis in steps (microsteps as fraction)"""
+        position, uposition = self._fast_axes[name].read_position()
+        return position + uposition / self.estimators[name].microsteps
+
+    def shutdown(self):
+        """Stops the completion monitor (pending futures are cancelled) and the axis queues, restores the move settings."""
+        self.monitor.stop()
+        for axis_queue in self.queues.values():
+            axis_queue.close()
+        try:
+            self.restore_move_settings()
+        except (ConnectionError, RuntimeError) as e:
+            print("Could not restore the move settings: {}".format(e))
@@ -0,0 +1,145 @@
+import time
+
+from trajectory_estimator import trapezoid_duration
+
+
+class MoveTimeModel:
+    """
+    Time of an XY move between two points in steps.
+
+    X and Y move concurrently, so a move takes as long as its slower axis. Each axis
+    follows the trapezoidal profile of its move settings (see TrajectoryEstimator).
+    """
+
+    def __init__(self, x_estimator, y_estimator):
+        self.x = (x_estimator.speed, x_estimator.accel, x_estimator.decel)
+        self.y = (y_estimator.speed, y_estimator.accel, y_estimator.decel)
+
+    def cost(self, a, b):
+        return max(trapezoid_duration(b[0] - a[0], *self.x),
+                   trapezoid_duration(b[1] - a[1], *self.y))
+
+
+def _cost_matrix(points, model):
+    n = len(points)
+    matrix = [[0.0] * n for _ in range(n)]
+    for i in range(n):
+        for j in range(i + 1, n):
+            matrix[i][j] = matrix[j][i] = model.cost(points[i], points[j])
+    return matrix
+
+
+def _nearest_neighbour(matrix):
+    """Greedy tour over point indices starting at point 0 (the start position)"""
+    n = len(matrix)
+    tour = [0]
+    left = set(range(1, n))
+    while left:
+        last = matrix[tour[-1]]
+        nearest = min(left, key=lambda j: last[j])
+        tour.append(nearest)
+        left.remove(nearest)
+    return tour
+
+
+def _two_opt(tour, matrix, deadline):
+    """Reverses tour[i..j] while that shortens the open path (tour[0] stays first)"""
+    n = len(tour)
+    improved = True
+    while improved and time.perf_counter() < deadline:
+        improved = False
+        for i in range(1, n - 1):
+            a, b = tour[i - 1], tour[i]
+            for j in range(i + 1, n):
+                c = tour[j]
+                d = tour[j + 1] if j + 1 < n else None
+                before = matrix[a][b] + (matrix[c][d] if d is not None else 0.0)
+                after = matrix[a][c] + (matrix[b][d] if d is not None else 0.0)
+                if after < before - 1e-12:
+                    tour[i:j + 1] = reversed(tour[i:j + 1])
+                    b = tour[i]
+                    improved = True
+            if time.perf_counter() >= deadline:
+                break
+    return tour
+
+
+def _or_opt(tour, matrix, deadline, max_segment=3):
+    """Moves segments of 1..max_segment points to a cheaper place in the tour"""
+    def link(p, q):
+        return matrix[p][q] if q is not None else 0.0
+
+    improved = True
+    while improved and time.perf_counter() < deadline:
+        improved = False
+        for length in range(1, max_segment + 1):
+            i = 1
+            while i + length <= len(tour):
+                prev, first, last = tour[i - 1], tour[i], tour[i + length - 1]
+                after = tour[i + length] if i + length < len(tour) else None
+                removed_gain = link(prev, first) + link(last, after) - link(prev, after)
+
+                segment = tour[i:i + length]
+                rest = tour[:i] + tour[i + length:]
+                best_delta, best_position, best_reversed = -1e-12, None, False
+                for k in range(len(rest)):
+                    p = rest[k]
+                    q = rest[k + 1] if k + 1 < len(rest) else None
+                    for reverse in (False, True):
+                        head, tail = (last, first) if reverse else (first, last)
+                        delta = link(p, head) + link(tail, q) - link(p, q) - removed_gain
+                        if delta < best_delta:
+                            best_delta, best_position, best_reversed = delta, k + 1, reverse
+
+                if best_position is not None:
+                    if best_reversed:
+                        segment.reverse()
+                    tour[:] = rest[:best_position] + segment + rest[best_position:]
+                    improved = True
+                else:
+                    i += 1
+                if time.perf_counter() >= deadline:
+                    return tour
+    return tour
+
+
+def optimize_order(coordinates, start, x_estimator, y_estimator, time_limit=0.5):
+    """
+    Reorders placements to minimise the total XY travel time.
+
+    Nearest-neighbour tour from the start position, refined with 2-opt and Or-opt
+    moves. The cost of a leg is the XY move time, max(t_x(|dx|), t_y(|dy|)).
+
+    Args:
+        coordinates (list): Coordinates to place
+        start (tuple): current (x, y) position in steps
+        x_estimator, y_estimator (TrajectoryEstimator): timing of the X and Y axes
+        time_limit (float): upper bound in seconds for the refinement
+
+    Returns:
+        list of the same Coordinates in visiting order
+    """
+    if len(coordinates) < 2:
+        return list(coordinates)
+
+    deadline = time.perf_counter() + time_limit
+    model = MoveTimeModel(x_estimator, y_estimator)
+    points = [start] + [(c.x_step, c.y_step) for c in coordinates]
+    matrix = _cost_matrix(points, model)
+
+    tour = _nearest_neighbour(matrix)
+    tour = _two_opt(tour, matrix, deadline)
+    tour = _or_opt(tour, matrix, deadline)
+    return [coordinates[i - 1] for i in tour[1:]]
+
+
+def path_duration(coordinates, start, x_estimator, y_estimator):
+    """Total XY travel time in seconds when visiting coordinates in the given order"""
+    model = MoveTimeModel(x_estimator, y_estimator)
+    total = 0.0
+    position = start
+    for c in coordinates:
+        target = (c.x_step, c.y_step)
+        total += model.cost(position, target)
+        position = target
+    return total
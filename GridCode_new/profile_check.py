@@ -0,0 +1,146 @@
+import hashlib
+from ctypes import byref, c_uint
+
+from profile_compiler import run_per_device, worse_result
+from settings_cache import settings_cache
+from ximc_import import ll, _check_result
+
+
+def fingerprint(serial, blocks):
+    """
+    SHA-256 over a controller's serial number and its settings blocks.
+
+    Args:
+        serial (int): controller serial number
+        blocks (list): (block name, structure bytes) pairs, stage_name included
+    """
+    digest = hashlib.sha256(str(serial).encode())
+    for block, data in sorted(blocks):
+        digest.update(block.encode() + b"\0" + data)
+    return digest.hexdigest()
+
+
+class ProfileReport:
+    """
+    Outcome of ensure_profile() for one controller.
+
+    Args:
+        profile (str): expected profile name
+        serial (int): controller serial number
+        expected (str): fingerprint of the profile on this controller
+        actual (str): fingerprint found at connect time
+        differing (list): blocks that did not match the profile at connect time
+        unreadable (list): blocks the controller does not report (not compared)
+        reloaded (bool): command_read_settings was issued
+        written (list): blocks written to the controller
+        result: worst libximc result of the writes
+    """
+
+    def __init__(self, profile, serial, expected, actual, differing, unreadable):
+        self.profile = profile
+        self.serial = serial
+        self.expected = expected
+        self.actual = actual
+        self.differing = differing
+        self.unreadable = unreadable
+        self.reloaded = False
+        self.written = []
+        self.result = ll.Result.Ok
+
+    @property
+    def matched(self):
+        return self.expected == self.actual
+
+    def __str__(self):
+        if self.matched:
+            return "Controller {} already holds profile {}".format(self.serial, self.profile)
+        text = "Controller {} differs from profile {} in: {}".format(self.serial, self.profile,
+                                                                      ", ".join(self.differing))
+        if self.reloaded:
+            text += "\n  settings reloaded from flash"
+        if self.written:
+            text += "\n  written: {}".format(", ".join(self.written))
+        if self.result != ll.Result.Ok:
+            text += "\n  writing returned {}".format(self.result)
+        if self.unreadable:
+            text += "\n  not compared (unreadable): {}".format(", ".join(self.unreadable))
+        return text
+
+
+def _compare(cache, blocks):
+    """Splits profile blocks into (controller blocks, differing names, unreadable names)"""
+    actual, differing, unreadable = [], [], []
+    for block, settings in blocks:
+        try:
+            data = bytes(cache.get(block))
+        except (ConnectionError, RuntimeError, ValueError):
+            unreadable.append(block)
+            continue
+        actual.append((block, data))
+        if data != bytes(settings):
+            differing.append(block)
+    return actual, differing, unreadable
+
+
+def ensure_profile(library, profile, device_id, reload=True):
+    """
+    Makes a controller hold a profile, touching it only if its settings differ.
+
+    Every block of the profile is read once (get_*), the fingerprint of the controller
+    is compared with that of the profile and nothing is written when they match. On a
+    mismatch the settings are first reloaded from the controller's flash with
+    command_read_settings (the right profile is usually stored there and only RAM was
+    changed), then the blocks that still differ are written.
+
+    Args:
+        library (ProfileLibrary): compiled profiles
+        profile (str): profile name in the library
+        device_id (int): device_t handle of an opened axis
+        reload (bool): try command_read_settings before writing
+
+    Returns:
+        ProfileReport
+    """
+    serial = c_uint()
+    _check_result(ll.lib.get_serial_number(device_id, byref(serial)))
+    cache = settings_cache(device_id)
+    blocks = library.blocks(profile)
+
+    actual, differing, unreadable = _compare(cache, blocks)
+    readable = [(block, bytes(settings)) for block, settings in blocks if block not in unreadable]
+    report = ProfileReport(profile, serial.value, fingerprint(serial.value, readable),
+                           fingerprint(serial.value, actual), differing, unreadable)
+    if report.matched:
+        return report
+
+    if reload:
+        _check_result(ll.lib.command_read_settings(device_id))
+        cache.invalidate()
+        report.reloaded = True
+        _, differing, _ = _compare(cache, blocks)
+
+    for block, settings in blocks:
+        if block in differing:
+            report.result = worse_result(report.result, cache.set(block, settings))
+            report.written.append(block)
+    return report
+
+
+def ensure_profiles(library, assignments, reload=True):
+    """
+    ensure_profile() for several controllers in parallel, one worker thread per device.
+
+    Args:
+        library (ProfileLibrary): compiled profiles
+        assignments (dict): device_t handle -> profile name
+        reload (bool): try command_read_settings before writing
+
+    Returns:
+        (worst result over all controllers, {device_t handle: ProfileReport})
+    """
+    reports = run_per_device(lambda device_id: ensure_profile(library, assignments[device_id], device_id, reload),
+                             assignments)
+    worst = ll.Result.Ok
+    for report in reports.values():
+        worst = worse_result(worst, report.result)
+    return worst, reports
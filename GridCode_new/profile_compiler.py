@@ -0,0 +1,183 @@
+import mmap
+import os
+import struct
+import sys
+from concurrent.futures import ThreadPoolExecutor
+from ctypes import sizeof
+
+from settings_cache import load_profile, settings_cache, settings_type
+from ximc_import import ll
+
+PROFILE_LIBRARY_FILE = os.path.join(os.path.abspath(os.path.dirname(__file__)), "profiles.gcp")
+
+# Profile library layout (little endian):
+#   file header:  magic, version, number of profiles
+#   index entry:  profile name, offset of its first block, number of blocks (one per profile)
+#   block:        settings block name (e.g. "move_settings"), structure size, packed *_settings_t bytes
+PROFILE_MAGIC = b"GCPF"
+PROFILE_VERSION = 1
+FILE_HEADER = struct.Struct("<4sHH")
+INDEX_ENTRY = struct.Struct("<32sII")
+BLOCK_HEADER = struct.Struct("<24sH")
+
+
+def worse_result(worst, result):
+    """Result aggregation of the generated profile scripts: the first real error wins over ValueError"""
+    if result != ll.Result.Ok and (worst == ll.Result.Ok or worst == ll.Result.ValueError):
+        return result
+    return worst
+
+
+class RecordingLib:
+    """Library stand-in that records the set_* calls of a profile function instead of sending them"""
+
+    def __init__(self):
+        self.blocks = []
+
+    def __getattr__(self, name):
+        if not name.startswith("set_"):
+            raise AttributeError("Profile scripts may only call set_* functions, not {}".format(name))
+
+        def record(device_id, settings):
+            self.blocks.append((name[4:], bytes(settings._obj)))
+            return ll.Result.Ok
+        return record
+
+
+def record_profile(path):
+    """
+    Runs a profile script without a controller.
+
+    Returns:
+        (profile name, [(block name, structure bytes), ...]) in the order the script writes them
+    """
+    profile = load_profile(path)
+    recorder = RecordingLib()
+    profile(recorder, 0)
+    return profile.__name__[len("set_profile_"):], recorder.blocks
+
+
+def compile_profiles(paths, output):
+    """Compiles profile scripts into one profile library file"""
+    profiles = [record_profile(path) for path in paths]
+    names = [name for name, _ in profiles]
+    if len(set(names)) != len(names):
+        raise ValueError("Duplicate profile names in {}".format(names))
+
+    offset = FILE_HEADER.size + INDEX_ENTRY.size * len(profiles)
+    index = b""
+    body = b""
+    for name, blocks in profiles:
+        index += INDEX_ENTRY.pack(name.encode(), offset + len(body), len(blocks))
+        for block, data in blocks:
+            body += BLOCK_HEADER.pack(block.encode(), len(data)) + data
+
+    with open(output, "wb") as f:
+        f.write(FILE_HEADER.pack(PROFILE_MAGIC, PROFILE_VERSION, len(profiles)))
+        f.write(index)
+        f.write(body)
+    return names
+
+
+class ProfileLibrary:
+    """
+    Memory-mapped profile library written by compile_profiles().
+
+    Only the index is parsed when the file is opened; the settings structures of a
+    profile are copied out of the mapping when it is applied. Every block size is
+    checked against the ctypes layout of the installed libximc, so a library compiled
+    for a different ximc.h is rejected instead of being written to a controller.
+
+    Args:
+        path (str): profile library file
+    """
+
+    def __init__(self, path):
+        self.path = path
+        with open(path, "rb") as f:
+            self._map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, count = FILE_HEADER.unpack_from(self._map, 0)
+        if magic != PROFILE_MAGIC or version != PROFILE_VERSION:
+            self._map.close()
+            raise ValueError("{} is not a version {} profile library".format(path, PROFILE_VERSION))
+        self.index = {}
+        for i in range(count):
+            name, offset, blocks = INDEX_ENTRY.unpack_from(self._map, FILE_HEADER.size + i * INDEX_ENTRY.size)
+            self.index[name.rstrip(b"\0").decode()] = (offset, blocks)
+
+    def names(self):
+        return list(self.index)
+
+    def blocks(self, name):
+        """Returns [(block name, settings structure), ...] of a profile"""
+        offset, count = self.index[name]
+        blocks = []
+        for _ in range(count):
+            block, size = BLOCK_HEADER.unpack_from(self._map, offset)
+            block = block.rstrip(b"\0").decode()
+            offset += BLOCK_HEADER.size
+            structure = settings_type(block)
+            if sizeof(structure) != size:
+                raise ValueError("{} in profile {} has {} bytes, this libximc expects {}"
+                                 .format(block, name, size, sizeof(structure)))
+            blocks.append((block, structure.from_buffer_copy(self._map, offset)))
+            offset += size
+        return blocks
+
+    def apply(self, name, device_id):
+        """
+        Writes a profile to a controller in one pass. Blocks the controller already holds
+        are skipped by its SettingsCache.
+
+        Returns:
+            worst_result like the profile script would
+        """
+        cache = settings_cache(device_id)
+        worst = ll.Result.Ok
+        for block, settings in self.blocks(name):
+            worst = worse_result(worst, cache.set(block, settings))
+        return worst
+
+    def apply_all(self, assignments):
+        """
+        Applies profiles to several controllers at once, one worker thread per device.
+        libximc serialises calls per device only, so this takes as long as the slowest
+        controller instead of the sum of all of them.
+
+        Args:
+            assignments (dict): device_t handle -> profile name
+
+        Returns:
+            (worst result over all controllers, {device_t handle: worst result of that controller})
+        """
+        results = run_per_device(lambda device_id: self.apply(assignments[device_id], device_id), assignments)
+        worst = ll.Result.Ok
+        for result in results.values():
+            worst = worse_result(worst, result)
+        return worst, results
+
+    def close(self):
+        self._map.close()
+
+
+def run_per_device(function, device_ids):
+    """
+    Calls function(device_id) for every device in parallel.
+
+    Returns:
+        {device_t handle: return value}; the first exception is raised after all workers finished
+    """
+    device_ids = list(device_ids)
+    if not device_ids:
+        return {}
+    with ThreadPoolExecutor(max_workers=len(device_ids)) as pool:
+        futures = {device_id: pool.submit(function, device_id) for device_id in device_ids}
+    return {device_id: future.result() for device_id, future in futures.items()}
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Usage: python profile_compiler.py <output library> <profile script> [<profile script> ...]")
+        sys.exit(1)
+    compiled = compile_profiles(sys.argv[2:], sys.argv[1])
+    print("Compiled {} profile(s) into {}: {}".format(len(compiled), sys.argv[1], ", ".join(compiled)))
@@ -0,0 +1,144 @@
+import threading
+from ctypes import byref
+
+from ximc_import import ll, _check_result
+
+
+def settings_type(block):
+    """ctypes structure of a settings block, e.g. "move_settings" -> move_settings_t"""
+    return getattr(ll, block + "_t")
+
+
+class SettingsCache:
+    """
+    Write-through cache of the settings blocks of one controller.
+
+    Every block (move_settings, engine_settings, ...) is read with its get_* function
+    the first time it is needed. set() compares the new structure byte by byte with
+    what the controller holds and only issues the set_* call for a block that really
+    changed. The cache assumes nothing else writes to the controller; call
+    invalidate() after an external change (e.g. command_read_settings).
+
+    Args:
+        device_id (int): device_t handle of an opened axis
+        lib: libximc library object (ll.lib)
+    """
+
+    def __init__(self, device_id, lib=None):
+        self.device_id = device_id
+        self.lib = lib if lib is not None else ll.lib
+        self._blocks = {}
+        self._lock = threading.Lock()
+        self.reads = 0
+        self.writes = 0
+        self.skipped = 0
+
+    def get(self, block):
+        """Returns a copy of a settings block, reading it from the controller only once"""
+        with self._lock:
+            data = self._read(block)
+        return settings_type(block).from_buffer_copy(data)
+
+    def _read(self, block):
+        data = self._blocks.get(block)
+        if data is None:
+            settings = settings_type(block)()
+            _check_result(getattr(self.lib, "get_" + block)(self.device_id, byref(settings)))
+            self.reads += 1
+            data = self._blocks[block] = bytes(settings)
+        return data
+
+    def set(self, block, settings):
+        """
+        Writes a settings block if it differs from the controller's.
+
+        Returns:
+            the libximc result code, Result.Ok for a skipped write
+        """
+        data = bytes(settings)
+        with self._lock:
+            try:
+                current = self._read(block)
+            except (ConnectionError, RuntimeError, ValueError):
+                # unreadable block, write it unconditionally
+                current = None
+            if current == data:
+                self.skipped += 1
+                return ll.Result.Ok
+            result = getattr(self.lib, "set_" + block)(self.device_id, byref(settings))
+            self.writes += 1
+            if result == ll.Result.Ok:
+                self._blocks[block] = data
+            else:
+                self._blocks.pop(block, None)
+            return result
+
+    def invalidate(self, block=None):
+        """Forgets one block, or everything when block is None"""
+        with self._lock:
+            if block is None:
+                self._blocks.clear()
+            else:
+                self._blocks.pop(block, None)
+
+
+class CachingLib:
+    """
+    Stands in for the libximc library object in the generated profile functions
+    (set_profile_*(lib, id)). Their lib.set_*(id, byref(settings)) calls go through
+    the SettingsCache of the device, so blocks the controller already has are not
+    written again. Any other function is passed to the real library.
+    """
+
+    def __init__(self, lib=None):
+        self.lib = lib if lib is not None else ll.lib
+
+    def __getattr__(self, name):
+        if name.startswith("set_") and hasattr(ll, name[4:] + "_t"):
+            block = name[4:]
+            return lambda device_id, settings: settings_cache(device_id, self.lib).set(block, settings._obj)
+        return getattr(self.lib, name)
+
+
+_caches = {}
+_caches_lock = threading.Lock()
+
+
+def settings_cache(device_id, lib=None):
+    """Returns the SettingsCache of a device handle, creating it on first use"""
+    with _caches_lock:
+        cache = _caches.get(device_id)
+        if cache is None:
+            cache = _caches[device_id] = SettingsCache(device_id, lib)
+        return cache
+
+
+def forget(device_id):
+    """Drops the cache of a closed device handle"""
+    with _caches_lock:
+        _caches.pop(device_id, None)
+
+
+def load_profile(path):
+    """
+    Loads a generated stage profile script (e.g. 8MTF-102LS05-MEn1.py) and returns its
+    set_profile_* function. The scripts expect the libximc names (Result, *_t, byref)
+    as globals.
+    """
+    namespace = dict(vars(ll))
+    with open(path) as f:
+        exec(compile(f.read(), path, "exec"), namespace)
+    functions = [value for name, value in namespace.items() if name.startswith("set_profile_") and callable(value)]
+    if len(functions) != 1:
+        raise ValueError("{} does not define exactly one set_profile_* function".format(path))
+    return functions[0]
+
+
+def apply_profile(profile, device_id, lib=None):
+    """
+    Runs a set_profile_* function against a device through its settings cache.
+
+    Returns:
+        the profile's worst_result
+    """
+    return profile(CachingLib(lib), device_id)
@@ -0,0 +1,210 @@
+import struct
+import threading
+import time
+from ctypes import byref, sizeof
+
+from ximc_import import ll, _check_result
+
+# Log layout (little endian):
+#   file header: magic, version, number of axes, then one 8 byte name per axis
+#   record:      kind, axis index, payload size, time [s since start], payload = raw libximc structure
+LOG_MAGIC = b"GCTL"
+LOG_VERSION = 1
+FILE_HEADER = struct.Struct("<4sHH")
+AXIS_NAME = struct.Struct("<8s")
+RECORD_HEADER = struct.Struct("<BBHd")
+
+STATUS, CHART_DATA, MEASUREMENTS = 1, 2, 3
+RECORD_TYPES = {STATUS: ll.status_t, CHART_DATA: ll.chart_data_t, MEASUREMENTS: ll.measurements_t}
+
+# ximc.h get_measurements: the buffer holds 25 points taken every 1 ms, should be read every
+# 20 ms (every 5 ms while it comes back full) and measuring stops by itself on overflow
+MEASUREMENT_POINTS = 25
+MEASUREMENTS_PERIOD = 0.02
+MEASUREMENTS_FULL_PERIOD = 0.005
+
+
+class RingBuffer:
+    """
+    Fixed size single-producer / single-consumer queue of byte records.
+
+    The producer only moves head and the consumer only moves tail, so no lock is
+    needed between the sampler and the writer thread. When the buffer is full new
+    records are dropped and counted.
+    """
+
+    def __init__(self, capacity):
+        self._slots = [None] * capacity
+        self._capacity = capacity
+        self._head = 0
+        self._tail = 0
+        self.dropped = 0
+
+    def push(self, record):
+        head = self._head
+        if head - self._tail >= self._capacity:
+            self.dropped += 1
+            return False
+        self._slots[head % self._capacity] = record
+        self._head = head + 1
+        return True
+
+    def drain(self):
+        """Returns all records pushed so far, oldest first"""
+        head = self._head
+        records = [self._slots[i % self._capacity] for i in range(self._tail, head)]
+        self._tail = head
+        return records
+
+
+class TelemetryRecorder:
+    """
+    Samples status_t and chart_data_t of every axis at a fixed rate, plus the controller's
+    25 point measurements_t buffer (speed and following error), and writes them to a
+    compact binary log. Sampling and file writing run on separate threads connected by
+    a RingBuffer, so disk latency never delays a sample.
+
+    The measurements buffer is read on its own schedule, every 20 ms and every 5 ms while
+    it comes back full. A full buffer means the controller may have stopped measuring
+    after an overflow, so measuring is started again. Empty buffers are not logged.
+    Every read looks the handle up by axis name, so a reopened axis goes on being
+    recorded and gets its measurements started on the new handle.
+
+    Args:
+        device_ids (dict): axis name -> device_t handle (shared, a reopened axis is picked up)
+        path (str): log file to write
+        rate_hz (float): status / chart data sampling rate
+        measurements (bool): record the measurements buffer
+        capacity (int): ring buffer size in records
+    """
+
+    def __init__(self, device_ids, path, rate_hz=100, measurements=True, capacity=65536):
+        self.device_ids = device_ids
+        # the log header fixes the axes and their indices
+        self.names = list(device_ids)
+        # axis name -> handle measuring was started on
+        self._measuring = {}
+        self.path = path
+        self.period = 1 / rate_hz
+        self.measurements = measurements
+        self.buffer = RingBuffer(capacity)
+        self.errors = 0
+        self._stop = threading.Event()
+        self._sampler = threading.Thread(target=self._sample_loop, name="telemetry-sampler", daemon=True)
+        self._writer = threading.Thread(target=self._write_loop, name="telemetry-writer", daemon=True)
+
+    def start(self):
+        self._file = open(self.path, "wb")
+        self._file.write(FILE_HEADER.pack(LOG_MAGIC, LOG_VERSION, len(self.names)))
+        for name in self.names:
+            self._file.write(AXIS_NAME.pack(name.encode()))
+        if self.measurements:
+            for name in self.names:
+                device_id = self.device_ids[name]
+                _check_result(ll.lib.command_start_measurements(device_id))
+                self._measuring[name] = device_id
+        self._start_time = time.perf_counter()
+        self._sampler.start()
+        self._writer.start()
+
+    def stop(self):
+        """Stops sampling and flushes everything recorded to the log"""
+        self._stop.set()
+        self._sampler.join()
+        self._writer.join()
+        self._file.close()
+        if self.buffer.dropped or self.errors:
+            print("Telemetry: {} record(s) dropped, {} read error(s)".format(self.buffer.dropped, self.errors))
+
+    def _read(self, kind, function, device_id, index):
+        structure = RECORD_TYPES[kind]()
+        if function(device_id, byref(structure)) != ll.Result.Ok:
+            self.errors += 1
+            return None
+        if kind != MEASUREMENTS or structure.Length:
+            t = time.perf_counter() - self._start_time
+            self.buffer.push(RECORD_HEADER.pack(kind, index, sizeof(structure), t) + bytes(structure))
+        return structure
+
+    def _read_measurements(self):
+        """Reads every measurements buffer, returns the delay until the next read"""
+        full = False
+        for index, name in enumerate(self.names):
+            device_id = self.device_ids[name]
+            if self._measuring.get(name) != device_id:
+                # the axis was reopened, the new handle has not been measuring
+                self._start_measurements(name, device_id)
+                continue
+            measurements = self._read(MEASUREMENTS, ll.lib.get_measurements, device_id, index)
+            if measurements is not None and measurements.Length >= MEASUREMENT_POINTS:
+                full = True
+                # the buffer may have overflowed, which stops measuring
+                self._start_measurements(name, device_id)
+        return MEASUREMENTS_FULL_PERIOD if full else MEASUREMENTS_PERIOD
+
+    def _start_measurements(self, name, device_id):
+        if ll.lib.command_start_measurements(device_id) == ll.Result.Ok:
+            self._measuring[name] = device_id
+        else:
+            self.errors += 1
+
+    def _sample_loop(self):
+        now = time.perf_counter()
+        next_sample = now
+        next_measurements = now + MEASUREMENTS_PERIOD if self.measurements else None
+        while not self._stop.is_set():
+            now = time.perf_counter()
+            if now >= next_sample:
+                for index, name in enumerate(self.names):
+                    device_id = self.device_ids[name]
+                    self._read(STATUS, ll.lib.get_status, device_id, index)
+                    self._read(CHART_DATA, ll.lib.get_chart_data, device_id, index)
+                next_sample += self.period
+                if next_sample < time.perf_counter():
+                    # fell behind, do not try to catch up with a burst of reads
+                    next_sample = time.perf_counter()
+            if next_measurements is not None and now >= next_measurements:
+                next_measurements = time.perf_counter() + self._read_measurements()
+            wake_up = next_sample if next_measurements is None else min(next_sample, next_measurements)
+            delay = wake_up - time.perf_counter()
+            if delay > 0:
+                self._stop.wait(delay)
+
+    def _write_loop(self):
+        while True:
+            stopping = self._stop.wait(0.1)
+            for record in self.buffer.drain():
+                self._file.write(record)
+            if stopping and not self._sampler.is_alive():
+                for record in self.buffer.drain():
+                    self._file.write(record)
+                return
+
+
+def read_log(path):
+    """
+    Reads a telemetry log.
+
+    Returns:
+        (names, records) where names lists the axes and records is a list of
+        (kind, axis name, time, ctypes structure) tuples in recording order
+    """
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, count = FILE_HEADER.unpack_from(data, 0)
+    if magic != LOG_MAGIC or version != LOG_VERSION:
+        raise ValueError("{} is not a version {} telemetry log".format(path, LOG_VERSION))
+    offset = FILE_HEADER.size
+    names = []
+    for _ in range(count):
+        names.append(AXIS_NAME.unpack_from(data, offset)[0].rstrip(b"\0").decode())
+        offset += AXIS_NAME.size
+
+    records = []
+    while offset + RECORD_HEADER.size <= len(data):
+        kind, index, size, t = RECORD_HEADER.unpack_from(data, offset)
+        offset += RECORD_HEADER.size
+        structure = RECORD_TYPES[kind].from_buffer_copy(data[offset:offset + size])
+        offset += size
+        records.append((kind, names[index], t, structure))
+    return names, records
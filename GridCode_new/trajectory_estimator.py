@@ -0,0 +1,83 @@
+import math
+from ctypes import byref
+
+from ximc_import import ll, _check_result
+
+
+def microsteps_per_step(microstep_mode):
+    """Number of microsteps in one full step for an engine_settings_t.MicrostepMode value"""
+    return 2 ** (microstep_mode - 1)
+
+
+def trapezoid_duration(distance, speed, accel, decel):
+    """
+    Duration in seconds of a point-to-point move that starts and ends at rest.
+
+    Args:
+        distance (float): move length in steps
+        speed (float): cruise speed in steps/s
+        accel (float): acceleration in steps/s^2 (0 disables the ramps)
+        decel (float): deceleration in steps/s^2 (0 disables the ramps)
+    """
+    distance = abs(distance)
+    if distance == 0 or speed <= 0:
+        return 0.0
+    if accel <= 0 or decel <= 0:
+        return distance / speed
+
+    ramp_distance = speed ** 2 / (2 * accel) + speed ** 2 / (2 * decel)
+    if distance >= ramp_distance:
+        return speed / accel + speed / decel + (distance - ramp_distance) / speed
+
+    # triangular profile: the cruise speed is never reached
+    peak_speed = math.sqrt(2 * distance * accel * decel / (accel + decel))
+    return peak_speed / accel + peak_speed / decel
+
+
+class TrajectoryEstimator:
+    """
+    Predicts how long a move of one axis takes from the controller's motion settings.
+
+    Speed, uSpeed, Accel and Decel are read once from move_settings_t, MicrostepMode and
+    the ENGINE_ACCEL_ON flag from engine_settings_t. Call refresh() after the settings of
+    the controller have been changed.
+
+    Args:
+        device_id (int): device_t handle of an opened axis
+    """
+
+    def __init__(self, device_id):
+        self.device_id = device_id
+        self.microsteps = 1
+        self.speed = 0.0
+        self.accel = 0.0
+        self.decel = 0.0
+        self.accel_on = True
+        self.refresh()
+
+    def refresh(self):
+        """Re-reads move_settings_t and engine_settings_t from the controller"""
+        move_settings = ll.move_settings_t()
+        engine_settings = ll.engine_settings_t()
+        _check_result(ll.lib.get_move_settings(self.device_id, byref(move_settings)))
+        _check_result(ll.lib.get_engine_settings(self.device_id, byref(engine_settings)))
+        self.update(move_settings, engine_settings)
+
+    def update(self, move_settings, engine_settings=None):
+        """
+        Takes new settings without reading them from the controller. Without engine_settings
+        the microstep mode and acceleration flag from the last update are kept.
+        """
+        if engine_settings is not None:
+            self.microsteps = microsteps_per_step(engine_settings.MicrostepMode)
+            self.accel_on = bool(engine_settings.EngineFlags & ll.EngineFlags.ENGINE_ACCEL_ON)
+        self.speed = move_settings.Speed + move_settings.uSpeed / self.microsteps
+        if self.accel_on:
+            self.accel = float(move_settings.Accel)
+            self.decel = float(move_settings.Decel)
+        else:
+            self.accel = self.decel = 0.0
+
+    def duration(self, start, target):
+        """Predicted time in seconds to move from start to target (both in steps)"""
+        return trapezoid_duration(target - start, self.speed, self.accel, self.decel)
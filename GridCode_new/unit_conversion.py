@@ -0,0 +1,112 @@
+from collections import namedtuple
+from fractions import Fraction
+
+from trajectory_estimator import microsteps_per_step
+
+# engine_settings_t.MicrostepMode set by the stage profiles (MICROSTEP_MODE_FRAC_256)
+DEFAULT_MICROSTEP_MODE = 9
+
+
+def exact(value):
+    """
+    Exact rational value of a number.
+
+    Floats are taken as the decimal they print as (12.345 is 12345/1000, not the binary
+    approximation stored in the float), which is what a coordinate typed in or computed
+    from µm means.
+    """
+    if isinstance(value, float):
+        return Fraction(repr(value))
+    return Fraction(value)
+
+
+def round_half_away(value):
+    """Nearest integer of a Fraction, halves away from zero so mirrored axes round alike"""
+    whole, remainder = divmod(abs(value.numerator), value.denominator)
+    if 2 * remainder >= value.denominator:
+        whole += 1
+    return whole if value >= 0 else -whole
+
+
+def split_microsteps(total, microsteps):
+    """
+    Total microsteps -> (Position, uPosition) as the controller reports them: Position
+    truncated towards zero and uPosition carrying the sign of the total.
+    """
+    position = abs(total) // microsteps
+    if total < 0:
+        position = -position
+    return position, total - position * microsteps
+
+
+class Target(namedtuple("Target", "position uposition microstep_mode")):
+    """
+    (Position, uPosition) of a move target together with the MicrostepMode its
+    uPosition counts in, so it stays valid whatever mode the controller turns out to run.
+    """
+
+    __slots__ = ()
+
+    @property
+    def microsteps(self):
+        return microsteps_per_step(self.microstep_mode)
+
+    @property
+    def steps(self):
+        """The target in steps as a float, exact for any realistic travel"""
+        return self.position + self.uposition / self.microsteps
+
+    def in_microsteps(self, microsteps):
+        """(Position, uPosition) counted in another number of microsteps per step, rounded to the nearest"""
+        if microsteps == self.microsteps:
+            return self.position, self.uposition
+        total = Fraction((self.position * self.microsteps + self.uposition) * microsteps, self.microsteps)
+        return split_microsteps(round_half_away(total), microsteps)
+
+
+class AxisScale:
+    """
+    Millimetres <-> (Position, uPosition) of one axis, in exact rational arithmetic.
+
+    A coordinate is scaled to microsteps of microstep_mode and rounded to the nearest
+    microstep, so a target is off by at most half a microstep (about 0.24 nm at 8000
+    steps/mm and 1/256 microstepping) instead of the up to one full step int()
+    truncation lost. The targets carry the mode; MotionEngine rescales them when a
+    controller runs a different one.
+
+    Args:
+        steps_per_mm (int): full steps per millimetre
+        direction (int): -1 if positive millimetres are negative steps
+        microstep_mode (int): engine_settings_t.MicrostepMode the targets are computed in
+    """
+
+    def __init__(self, steps_per_mm, direction=1, microstep_mode=DEFAULT_MICROSTEP_MODE):
+        self.steps_per_mm = Fraction(steps_per_mm)
+        self.direction = direction
+        self.microstep_mode = microstep_mode
+
+    @property
+    def microsteps(self):
+        return microsteps_per_step(self.microstep_mode)
+
+    def to_targets(self, mm):
+        """[mm] -> [Target], the scale factor is worked out once for the batch"""
+        microsteps = self.microsteps
+        factor = self.direction * self.steps_per_mm * microsteps
+        return [Target(*split_microsteps(round_half_away(exact(value) * factor), microsteps), self.microstep_mode)
+                for value in mm]
+
+    def to_target(self, mm):
+        return self.to_targets((mm,))[0]
+
+    def to_mm(self, position, uposition=0):
+        """(Position, uPosition) -> exact millimetres as a Fraction"""
+        return (Fraction(position) + Fraction(uposition, self.microsteps)) / (self.direction * self.steps_per_mm)
+
+
+# 8MT200 stages: X and Y 8000 steps/mm, mounted so positive mm are negative steps; Z 4000 steps/mm
+AXES = {
+    "x": AxisScale(8000, -1),
+    "y": AxisScale(8000, -1),
+    "z": AxisScale(4000),
+}
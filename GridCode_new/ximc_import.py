@@ -0,0 +1,21 @@
+"""
+libximc for every module: the installed package if there is one, else the Python
+wrapper shipped in ../ximc.
+
+    from ximc_import import ll, ximc, _check_result
+"""
+import os
+import sys
+
+try:
+    import libximc.highlevel as ximc
+except ImportError:
+    cur_dir = os.path.abspath(os.path.dirname(__file__))
+    ximc_dir = os.path.join(cur_dir, "..", "ximc")
+    ximc_package_dir = os.path.join(ximc_dir, "crossplatform", "wrappers", "python")
+    sys.path.append(ximc_package_dir)
+    import libximc.highlevel as ximc
+
+from libximc.highlevel import _highlevel
+from libximc.highlevel._highlevel import _check_result
+from libximc.lowlevel import _lowlevel as ll
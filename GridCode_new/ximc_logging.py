@@ -0,0 +1,98 @@
+import collections
+import sys
+import threading
+import time
+from ctypes import CFUNCTYPE, c_int, c_void_p, c_wchar_p
+
+from ximc_import import ll
+
+# ximc.h log levels
+LOGLEVEL_ERROR, LOGLEVEL_WARNING, LOGLEVEL_INFO, LOGLEVEL_DEBUG = 1, 2, 3, 4
+LEVEL_NAMES = {LOGLEVEL_ERROR: "ERROR", LOGLEVEL_WARNING: "WARNING", LOGLEVEL_INFO: "INFO", LOGLEVEL_DEBUG: "DEBUG"}
+
+# logging_callback_t is XIMC_CALLCONV, i.e. __stdcall on Windows
+if sys.platform == "win32":
+    from ctypes import WINFUNCTYPE as _CALLBACK_TYPE
+else:
+    _CALLBACK_TYPE = CFUNCTYPE
+logging_callback_t = _CALLBACK_TYPE(None, c_int, c_wchar_p, c_void_p)
+
+
+class AsyncLogSink:
+    """
+    libximc logging callback that never blocks the thread issuing the command.
+
+    The callback registered with set_logging_callback only takes a timestamp and
+    appends (time, level, message) to a bounded queue; a deque append is atomic, so
+    any number of libximc threads can log without a lock. A background thread formats
+    the records and writes them to the log file. When the queue is full a message is
+    dropped and counted instead of waiting. Per-level sampling keeps only every n-th
+    message of a level, e.g. {LOGLEVEL_DEBUG: 10} for debug logging in production.
+
+    Args:
+        path (str): log file, None for stderr
+        capacity (int): maximum number of queued messages
+        sample (dict): log level -> keep one message in n (levels not listed keep everything)
+        max_level (int): messages above this level are ignored
+        flush_interval (float): seconds between writer passes
+    """
+
+    def __init__(self, path=None, capacity=65536, sample=None, max_level=LOGLEVEL_DEBUG, flush_interval=0.2):
+        self.path = path
+        self.capacity = capacity
+        self.sample = dict(sample or {})
+        self.max_level = max_level
+        self.flush_interval = flush_interval
+        self.dropped = 0
+        self.sampled_out = 0
+        self._seen = collections.Counter()
+        self._records = collections.deque()
+        self._stop = threading.Event()
+        self._writer = threading.Thread(target=self._write_loop, name="ximc-log-writer", daemon=True)
+        # keep a reference, libximc calls it until the callback is replaced
+        self._callback = logging_callback_t(self._on_message)
+
+    def start(self):
+        self._file = open(self.path, "a", encoding="utf-8") if self.path else sys.stderr
+        self._writer.start()
+        ll.lib.set_logging_callback(self._callback, None)
+
+    def stop(self):
+        """Puts libximc's default logger back and writes out everything queued"""
+        ll.lib.set_logging_callback(logging_callback_t(), None)
+        self._stop.set()
+        self._writer.join()
+        if self.dropped:
+            self._file.write("{} libximc log message(s) dropped\n".format(self.dropped))
+        if self._file is not sys.stderr:
+            self._file.close()
+
+    def _on_message(self, level, message, user_data):
+        # runs on the libximc caller's thread: no formatting, no I/O, no waiting
+        if level > self.max_level:
+            return
+        every = self.sample.get(level, 1)
+        if every > 1:
+            self._seen[level] += 1
+            if (self._seen[level] - 1) % every:
+                self.sampled_out += 1
+                return
+        if len(self._records) >= self.capacity:
+            self.dropped += 1
+            return
+        self._records.append((time.time(), level, message))
+
+    def _write(self):
+        lines = []
+        while self._records:
+            t, level, message = self._records.popleft()
+            lines.append("{}.{:03d} {:<7} {}\n".format(time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(t)),
+                                                      int(t % 1 * 1000), LEVEL_NAMES.get(level, level), message))
+        if lines:
+            self._file.write("".join(lines))
+            self._file.flush()
+
+    def _write_loop(self):
+        while not self._stop.wait(self.flush_interval):
+            self._write()
+        self._write()